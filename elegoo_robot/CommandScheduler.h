@@ -0,0 +1,313 @@
+// Command scheduler
+// Runs command sequences (the handle*() functions in elegoo_robot.ino) side by side.
+// - Each command declares the subsystems it needs.  Commands that don't share a subsystem run
+//   at the same time, and starting a command cancels any running command it conflicts with.
+// - Commands can be put together into sequential and parallel groups.
+// - Everything is statically allocated (MAX_COMMANDS slots, groups and their members included).
+// - CommandDefs and group step tables live in flash (PROGMEM) and are read with the get*()
+//   helpers below, so a new routine is a step table, not a new handler, and costs no SRAM.
+//
+// Handlers work the same way they did with the old single g_cmdSeqCtrl slot: run the step in
+// cmd.curStep, set cmd.isRunning = false when done, and clean up when called with
+// cmd.isRunning false (which is also how a cancel is delivered).
+#ifndef COMMANDSCHEDULER_H
+#define COMMANDSCHEDULER_H
+
+#include "Hal.h"
+#include "Timer.h"
+#include "EventLog.h"
+
+// Subsystems (CommandDef::requirements bits)
+#define REQ_NONE        0x00
+#define REQ_DRIVETRAIN  0x01
+#define REQ_ELEVATOR    0x02
+#define REQ_GRIPPER     0x04
+
+#define MAX_COMMANDS    8       // Running commands, including groups and their members
+#define NO_COMMAND      0xFF
+
+enum CommandTypes {
+  cmdSingle = 0,    // Runs a handler
+  cmdSequential,    // Runs its steps one after another
+  cmdParallel       // Runs its steps at the same time, done when they all are
+};
+
+struct Command;
+struct CommandDef;
+
+typedef void (*CommandHandler)(Command &cmd);
+
+// One member of a group, with the param it's started with
+struct CommandStep {
+  const CommandDef *pDef;
+  int param;
+};
+
+// What a command is.  Groups get their requirements from their steps and need at least one.
+// Declare these (and their step tables) PROGMEM.
+struct CommandDef {
+  CommandHandler handler;         // cmdSingle only
+  uint8_t requirements;           // cmdSingle only
+  uint8_t type;
+  const CommandStep *pSteps;      // Groups only
+  uint8_t numSteps;
+};
+
+// A running command
+struct Command {
+  const CommandDef *pDef;   // NULL when the slot is free (points into flash)
+  bool isRunning;           // Handler sets this to false when done
+  int param;                // Parameter for the handler (use varies by handler)
+  int curStep;              // Current step in the command sequence (or group)
+  Timer timer;              // For handlers that need to wait
+  uint8_t parent;           // Group this is a member of (NO_COMMAND at the top level)
+  uint8_t activeSteps;      // Members still running (parallel groups)
+};
+
+
+class CommandScheduler {
+private:
+  Command m_commands[MAX_COMMANDS];
+
+  ////////////////////////////////////////////////////////////////////
+  // Read the parts of a CommandDef out of flash
+  static uint8_t getType(const CommandDef *pDef) {
+    return pgm_read_byte(&pDef->type);
+  }
+  static CommandHandler getHandler(const CommandDef *pDef) {
+    return (CommandHandler)pgm_read_ptr(&pDef->handler);
+  }
+  static uint8_t getNumSteps(const CommandDef *pDef) {
+    return pgm_read_byte(&pDef->numSteps);
+  }
+  static void getStep(const CommandDef *pDef, uint8_t idx, CommandStep *pStep) {
+    const CommandStep *pSteps = (const CommandStep *)pgm_read_ptr(&pDef->pSteps);
+    memcpy_P(pStep, &pSteps[idx], sizeof(CommandStep));
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Start a command in a free slot.  Returns the slot or NO_COMMAND if there's no room (for it
+  // or one of its members).
+  // Handlers don't get called here (they run from the next run()), so a sequence of commands
+  // that finish straight away doesn't recurse.
+  uint8_t start(const CommandDef *pDef, int param, uint8_t parent) {
+    uint8_t idx = 0;
+    while(idx < MAX_COMMANDS && m_commands[idx].pDef) {
+      idx++;
+    }
+    if(idx >= MAX_COMMANDS) {
+      g_log.log(logNoCommandSlot);
+      return NO_COMMAND;
+    }
+
+    Command &cmd = m_commands[idx];
+    cmd.pDef = pDef;
+    cmd.isRunning = true;
+    cmd.param = param;
+    cmd.curStep = 0;
+    cmd.parent = parent;
+    cmd.activeSteps = 0;
+
+    uint8_t type = getType(pDef);
+    if(type == cmdSequential) {
+      startStep(idx);
+    }
+    else if(type == cmdParallel) {
+      uint8_t numSteps = getNumSteps(pDef);
+      for(uint8_t i = 0; i < numSteps && m_commands[idx].pDef; i++) {
+        CommandStep step;
+        getStep(pDef, i, &step);
+        m_commands[idx].activeSteps++;
+        if(start(step.pDef, step.param, idx) == NO_COMMAND) {
+          cancelSlot(idx);
+        }
+      }
+    }
+    return m_commands[idx].pDef ? idx : NO_COMMAND;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Start the current step of a sequential group (or finish it if there are no more)
+  void startStep(uint8_t idx) {
+    Command &cmd = m_commands[idx];
+    if(cmd.curStep >= getNumSteps(cmd.pDef)) {
+      finish(idx);
+      return;
+    }
+    CommandStep step;
+    getStep(cmd.pDef, cmd.curStep, &step);
+    if(start(step.pDef, step.param, idx) == NO_COMMAND) {
+      cancelTop(idx);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Free a finished command's slot and let its group know
+  void finish(uint8_t idx) {
+    uint8_t parent = m_commands[idx].parent;
+    m_commands[idx].pDef = NULL;
+    if(parent == NO_COMMAND) {
+      return;
+    }
+
+    Command &group = m_commands[parent];
+    if(getType(group.pDef) == cmdSequential) {
+      group.curStep++;
+      startStep(parent);
+    }
+    else if(--group.activeSteps == 0) {
+      finish(parent);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Cancel a command and everything under it.  Handlers get called with isRunning false so
+  // they clean up.
+  void cancelSlot(uint8_t idx) {
+    if(!m_commands[idx].pDef) {
+      return;   // Already gone with its top-level command (see cancelTop())
+    }
+    for(uint8_t i = 0; i < MAX_COMMANDS; i++) {
+      if(m_commands[i].pDef && m_commands[i].parent == idx) {
+        cancelSlot(i);
+      }
+    }
+    Command &cmd = m_commands[idx];
+    if(getType(cmd.pDef) == cmdSingle && cmd.isRunning) {
+      cmd.isRunning = false;
+      getHandler(cmd.pDef)(cmd);
+    }
+    cmd.pDef = NULL;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Cancel the top-level command a command is part of.  When a group member can't start, the
+  // groups above it would otherwise wait for it forever (and keep their subsystems busy).
+  void cancelTop(uint8_t idx) {
+    if(!m_commands[idx].pDef) {
+      return;
+    }
+    while(m_commands[idx].parent != NO_COMMAND) {
+      idx = m_commands[idx].parent;
+    }
+    cancelSlot(idx);
+  }
+
+public:
+  CommandScheduler() {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Initializer (constructor wasn't a good place to do this)
+  void init() {
+    for(uint8_t i = 0; i < MAX_COMMANDS; i++) {
+      m_commands[i].pDef = NULL;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Subsystems a command (or group) needs
+  static uint8_t getRequirements(const CommandDef *pDef) {
+    if(getType(pDef) == cmdSingle) {
+      return pgm_read_byte(&pDef->requirements);
+    }
+    uint8_t requirements = REQ_NONE;
+    uint8_t numSteps = getNumSteps(pDef);
+    for(uint8_t i = 0; i < numSteps; i++) {
+      CommandStep step;
+      getStep(pDef, i, &step);
+      requirements |= getRequirements(step.pDef);
+    }
+    return requirements;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Start a command, cancelling any running commands that need the same subsystems.  Returns
+  // false if it couldn't be started.
+  bool schedule(const CommandDef *pDef, int param = 0) {
+    cancel(getRequirements(pDef));
+    return start(pDef, param, NO_COMMAND) != NO_COMMAND;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Cancel the running commands that use any of the given subsystems
+  void cancel(uint8_t requirements) {
+    for(uint8_t i = 0; i < MAX_COMMANDS; i++) {
+      if(m_commands[i].pDef && m_commands[i].parent == NO_COMMAND &&
+         (getRequirements(m_commands[i].pDef) & requirements)) {
+        cancelSlot(i);
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Cancel everything
+  void cancelAll() {
+    for(uint8_t i = 0; i < MAX_COMMANDS; i++) {
+      if(m_commands[i].pDef && m_commands[i].parent == NO_COMMAND) {
+        cancelSlot(i);
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Run one step of every running command.  Call every loop.
+  void run() {
+    for(uint8_t i = 0; i < MAX_COMMANDS; i++) {
+      Command &cmd = m_commands[i];
+      if(cmd.pDef && getType(cmd.pDef) == cmdSingle) {
+        getHandler(cmd.pDef)(cmd);
+        if(!cmd.isRunning) {
+          finish(i);
+        }
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns true if any command is running
+  bool isRunning() {
+    for(uint8_t i = 0; i < MAX_COMMANDS; i++) {
+      if(m_commands[i].pDef) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns true if the command is running at the top level
+  bool isScheduled(const CommandDef *pDef) {
+    for(uint8_t i = 0; i < MAX_COMMANDS; i++) {
+      if(m_commands[i].pDef == pDef && m_commands[i].parent == NO_COMMAND) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Current step of the first top-level command (-1 if nothing is running).  For a sequential
+  // group like auto, this is how far through it is.
+  int getStep() {
+    for(uint8_t i = 0; i < MAX_COMMANDS; i++) {
+      if(m_commands[i].pDef && m_commands[i].parent == NO_COMMAND) {
+        return m_commands[i].curStep;
+      }
+    }
+    return -1;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Subsystems in use by running commands
+  uint8_t getBusySubsystems() {
+    uint8_t requirements = REQ_NONE;
+    for(uint8_t i = 0; i < MAX_COMMANDS; i++) {
+      if(m_commands[i].pDef && m_commands[i].parent == NO_COMMAND) {
+        requirements |= getRequirements(m_commands[i].pDef);
+      }
+    }
+    return requirements;
+  }
+};
+
+#endif
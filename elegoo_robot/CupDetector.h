@@ -0,0 +1,123 @@
+// Cup detector for the scan turn
+// Finds the first cup in the ultrasonic readings one reading at a time, as they come in while
+// the robot turns.  Each reading is tagged with how far the robot had turned (encoder ticks)
+// when it came in, so the cup's centre is known as a position on the turn even if the turn
+// speed varies.  Only the cup so far is kept (start and end ticks, closest reading), not the
+// readings.
+// - The cup starts at the first reading inside the range.
+// - A reading more than CUP_EDGE_MM closer than the cup restarts it there (a closer cup in
+//   front of a farther one).
+// - A reading more than CUP_EDGE_MM farther (or beyond the range) is past its far edge, and the
+//   cup is found.
+// - No-echo readings (-1, too close or too far) are ignored.
+#ifndef CUPDETECTOR_H
+#define CUPDETECTOR_H
+
+#include "Hal.h"
+
+#define CUP_EDGE_MM   50    // Change in distance at the edge of a cup
+
+enum CupDetectorStates {
+  cupSearching = 0,   // Nothing in range yet
+  cupInside,          // Readings are on a cup
+  cupFound            // Gone past the far edge of the cup
+};
+
+class CupDetector {
+private:
+  uint8_t m_state;
+  int m_maxDistanceMm;
+  int m_startTicks;     // First reading on the cup
+  int m_endTicks;       // Last reading on the cup
+  int m_distanceMm;     // Closest reading on the cup
+  uint8_t m_readings;   // Readings so far (saturates)
+
+public:
+  ////////////////////////////////////////////////////////////////////
+  // Constructor
+  CupDetector() {
+    reset(0);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Start a new scan.  Only readings under maxDistanceMm can be a cup.
+  void reset(int maxDistanceMm) {
+    m_state = cupSearching;
+    m_maxDistanceMm = maxDistanceMm;
+    m_startTicks = 0;
+    m_endTicks = 0;
+    m_distanceMm = 0;
+    m_readings = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Add a reading (mm, see UltrasonicSensor::getReadingMm()) taken ticks into the turn.
+  // Returns true once the whole cup has been seen (there's no need to keep turning).
+  bool addReading(int distanceMm, int ticks) {
+    if(m_readings != 0xff) {
+      m_readings++;
+    }
+    if(distanceMm == -1 || m_state == cupFound) {
+      return m_state == cupFound;
+    }
+
+    if(m_state == cupSearching) {
+      if(distanceMm < m_maxDistanceMm) {
+        m_state = cupInside;
+        m_startTicks = ticks;
+        m_endTicks = ticks;
+        m_distanceMm = distanceMm;
+      }
+    }
+    else if(m_distanceMm - distanceMm > CUP_EDGE_MM) {
+      // A closer cup, start again from here
+      m_startTicks = ticks;
+      m_endTicks = ticks;
+      m_distanceMm = distanceMm;
+    }
+    else if(distanceMm - m_distanceMm > CUP_EDGE_MM) {
+      m_state = cupFound;
+    }
+    else {
+      m_endTicks = ticks;
+      if(distanceMm < m_distanceMm) {
+        m_distanceMm = distanceMm;
+      }
+    }
+    return m_state == cupFound;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns true if a cup was seen (found, or still going when the scan ended)
+  bool hasCup() {
+    return m_state != cupSearching;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns true if the far edge of the cup has been seen
+  bool isFound() {
+    return m_state == cupFound;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Centre of the cup (ticks into the turn).  If the scan ended on the cup, pass where it ended
+  // as the far edge.
+  int getCentreTicks(int scanEndTicks) {
+    int endTicks = (m_state == cupFound) ? m_endTicks : scanEndTicks;
+    return m_startTicks + (endTicks - m_startTicks) / 2;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Closest reading on the cup (mm)
+  int getDistanceMm() {
+    return m_distanceMm;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Readings so far (up to 255), for the log
+  uint8_t getReadings() {
+    return m_readings;
+  }
+};
+
+#endif
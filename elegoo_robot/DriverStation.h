@@ -2,6 +2,8 @@
 #ifndef DRIVERSTATION_H
 #define DRIVERSTATION_H
 
+#include "Hal.h"
+
 // ToDo:
 //  Add Watchdog to ensure loops are not taking too long.
 // 
@@ -12,6 +14,24 @@
 // Data should arrive every 100ms on average...give a little leaway
 #define DATA_EXPIRE_TIME    110
 
+// Packet header
+#define DS_PREAMBLE         0xA5
+#define DS_VERSION          1
+
+// Most bytes bUpdate() takes from Serial per call (two packets' worth), so a burst of data
+// doesn't stall the loop.  Anything left stays in the Serial buffer for the next call.
+#define DS_MAX_BYTES_PER_UPDATE 32
+
+// Link status, see getStatus().  Counts saturate.
+struct DsStatus {
+  uint32_t  u32FramesOk;
+  uint16_t  u16BadVersion;
+  uint16_t  u16BadSize;
+  uint16_t  u16BadChecksum;
+  uint16_t  u16WatchdogExpiries;  // Times the controls were masked because data stopped
+  uint16_t  u16MaxGapMs;          // Longest time between good packets
+};
+
 enum {
   ePreGame,
   eAutonomous,
@@ -22,6 +42,7 @@ enum {
 class DriverStation {
   uint32_t  m_u32StateChangeTime;
   uint32_t  m_u32DataExpireTime;
+  uint32_t  m_u32LastPacketTime;
   union {
     struct GameData {
       uint8_t   u8Preamble;
@@ -42,6 +63,7 @@ class DriverStation {
     uint8_t gru8Buff[sizeof(gd)];
   } m_inBuff;
   uint8_t  m_u8Rcvd;
+  uint16_t m_u16Sum;      // Running checksum of the bytes received so far
   uint8_t  m_u8GameState;
   uint16_t m_u16Buttons;
   uint8_t  m_u8LTrig;
@@ -51,7 +73,8 @@ class DriverStation {
   int8_t   m_i8RX;
   int8_t   m_i8RY;
   bool     m_bValid;
-  bool     m_bSlowSent;
+  bool     m_bWDCounted;    // This watchdog expiry has been counted
+  DsStatus m_status;
   
 #if DS_DEBUG
   char grcHex[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
@@ -66,24 +89,75 @@ class DriverStation {
 
   void vWatchDogReset() {
     m_u32DataExpireTime = millis() + DATA_EXPIRE_TIME;
-    m_bSlowSent = false;
+    m_bWDCounted = false;
   }
   bool bWDExpired() {
-    if( m_bSlowSent || millis() > m_u32DataExpireTime ) { 
-      if( !m_bSlowSent ) {
-        Serial.println( "Watchdog: Loop took too long" );
-        m_bSlowSent = true;
+    if( m_bWDCounted || (int32_t)( millis() - m_u32DataExpireTime ) > 0 ) { 
+      if( !m_bWDCounted ) {
+        vCount( m_status.u16WatchdogExpiries );
+        m_bWDCounted = true;
       }
       return true;
     }
     return false;
   }
+
+  // Errors are counted rather than printed: a print can block the loop for milliseconds once
+  // the Serial TX buffer is full, which is just when the link is having trouble.
+  static void vCount( uint16_t &u16Counter ) {
+    if( u16Counter != 0xffff )
+      u16Counter++;
+  }
+
+  // Check byte u8Pos of the packet being received and add it to the running checksum.
+  // Returns false if it can't be part of a packet.
+  bool bCheckByte( uint8_t u8Pos ) {
+    uint8_t c = m_inBuff.gru8Buff[u8Pos];
+    if( u8Pos == 0 ) {
+      m_u16Sum = 0;
+      if( c != DS_PREAMBLE )
+        return false;
+    }
+    else if( u8Pos == 1 && c != DS_VERSION ) {
+      vCount( m_status.u16BadVersion );
+      return false;
+    }
+    else if( u8Pos == 2 && c != sizeof(m_inBuff.gd) ) {
+      vCount( m_status.u16BadSize );
+      return false;
+    }
+    if( u8Pos < sizeof(m_inBuff.gd) - 2 )
+      m_u16Sum += c;
+    return true;
+  }
+
+  // The packet being received is bad.  Drop its first byte and look for a new packet start
+  // in the bytes already received (a preamble that turned up inside the bad data), so the
+  // next good packet isn't lost along with it.
+  void vResync() {
+    bool bOk;
+    do {
+      // Drop bytes up to the next preamble
+      uint8_t u8Skip = 1;
+      while( u8Skip < m_u8Rcvd && m_inBuff.gru8Buff[u8Skip] != DS_PREAMBLE )
+        u8Skip++;
+      m_u8Rcvd -= u8Skip;
+      memmove( m_inBuff.gru8Buff, m_inBuff.gru8Buff + u8Skip, m_u8Rcvd );
+
+      // Check what's left again (it can fail too)
+      bOk = true;
+      for( uint8_t i = 0; i < m_u8Rcvd && bOk; i++ )
+        bOk = bCheckByte( i );
+    } while( !bOk );
+  }
 public:
   DriverStation() :
     m_u32StateChangeTime( millis() ),
     m_u8Rcvd( 0 ),
+    m_u16Sum( 0 ),
     m_bValid( false ),
-    m_bSlowSent( false ) {
+    m_bWDCounted( false ) {
+    vResetStatus();
   }
   ~DriverStation() {
   }
@@ -111,82 +185,93 @@ public:
   // Request button state
   bool getButton( uint8_t buttonId ) {
     if( buttonId >=16 ) {
-      Serial.print( "DriverStation::getButton(): Invalid Button ID requested " ); Serial.println( buttonId );
+      Serial.print( F( "DriverStation::getButton(): Invalid Button ID requested " ) ); Serial.println( buttonId );
       return false;
     }
     return WDOG_MASK((m_u16Buttons & (1 << buttonId)) ? true : false);
   }
   
+  // Link status counters (since power-up or vResetStatus())
+  const DsStatus &getStatus() const { return m_status; }
+
+  void vResetStatus() {
+    m_status.u32FramesOk = 0;
+    m_status.u16BadVersion = 0;
+    m_status.u16BadSize = 0;
+    m_status.u16BadChecksum = 0;
+    m_status.u16WatchdogExpiries = 0;
+    m_status.u16MaxGapMs = 0;
+  }
+
+  // Print the link status.  Blocks while Serial drains, so only call it on request.
+  void vPrintStatus() {
+    Serial.print( F( "DS ok " ) ); Serial.print( m_status.u32FramesOk );
+    Serial.print( F( " ver " ) ); Serial.print( m_status.u16BadVersion );
+    Serial.print( F( " size " ) ); Serial.print( m_status.u16BadSize );
+    Serial.print( F( " sum " ) ); Serial.print( m_status.u16BadChecksum );
+    Serial.print( F( " wdog " ) ); Serial.print( m_status.u16WatchdogExpiries );
+    Serial.print( F( " gap " ) ); Serial.print( m_status.u16MaxGapMs ); Serial.println( F( "ms" ) );
+  }
+
   // Update function must be called repeatedly to read control data from
   // the DriverStation application.
   // When this function returns true, it indicates that new controller
   // data is available.
+  //
+  // Takes at most DS_MAX_BYTES_PER_UPDATE bytes per call.  The checksum is added up as the
+  // bytes come in.  After a bad byte the parser looks for the next preamble in what it has
+  // already received rather than waiting for a new one.
   bool bUpdate() {
-    while( Serial.available() ) {
-      int c = Serial.read();
-  
-      if( m_u8Rcvd == 0 ) {
-        if( c == 0xA5 )
-          m_inBuff.gru8Buff[m_u8Rcvd++] = c & 0xff;
-      }
-      else if( m_u8Rcvd == 1 ) {
-        if( c == 1 ) {
-          m_inBuff.gru8Buff[m_u8Rcvd++] = c & 0xff;
-        }
-        else {
-          Serial.println( "DriverStation: Incorrect Version" );
-          m_u8Rcvd = 0;
-        }
-      }
-      else if( m_u8Rcvd == 2 ) {
-        if( c == sizeof(m_inBuff.gd) ) {
-          m_inBuff.gru8Buff[m_u8Rcvd++] = c & 0xff;
-        }
-        else {
-          Serial.println( "DriverStation: Incorrect Size" );
-          m_u8Rcvd = 0;
-        }
+    for( uint8_t u8Count = 0; u8Count < DS_MAX_BYTES_PER_UPDATE && Serial.available(); u8Count++ ) {
+      uint8_t u8Pos = m_u8Rcvd++;
+      m_inBuff.gru8Buff[u8Pos] = Serial.read() & 0xff;
+
+      if( !bCheckByte( u8Pos ) ) {
+        vResync();
       }
-      else if( m_u8Rcvd < sizeof(m_inBuff.gd) )
-      {
-        m_inBuff.gru8Buff[m_u8Rcvd++] = c & 0xff;
-        if( m_u8Rcvd == sizeof(m_inBuff.gd) ) {
+      else if( m_u8Rcvd == sizeof(m_inBuff.gd) ) {
+        if( m_u16Sum == m_inBuff.gd.u16Sum ) {
           m_u8Rcvd = 0;   // get ready for next packet
 
-          uint16_t sum = 0;
-          for( uint8_t i = 0; i < sizeof(m_inBuff.gd) - 2; i++ ) {
-            sum += m_inBuff.gru8Buff[i];
+          // Link stats
+          uint32_t u32Now = millis();
+          if( m_status.u32FramesOk ) {
+            uint32_t u32Gap = u32Now - m_u32LastPacketTime;
+            if( u32Gap > m_status.u16MaxGapMs )
+              m_status.u16MaxGapMs = (u32Gap > 0xffff) ? 0xffff : u32Gap;
           }
+          m_u32LastPacketTime = u32Now;
+          if( m_status.u32FramesOk != 0xffffffff )
+            m_status.u32FramesOk++;
+
+          // if the game state has changed, remember when it happend
+          if( m_u8GameState != m_inBuff.gd.u8GameState )
+            m_u32StateChangeTime = u32Now;
+
+          // update the DriverStation info
+          m_u8GameState = m_inBuff.gd.u8GameState;
+          m_u16Buttons = m_inBuff.gd.u16Buttons;
+          m_u8LTrig = m_inBuff.gd.u8LTrig;
+          m_u8RTrig = m_inBuff.gd.u8RTrig;
+          m_i8LX = m_inBuff.gd.i8LX;
+          m_i8LY = m_inBuff.gd.i8LY;
+          m_i8RX = m_inBuff.gd.i8RX;
+          m_i8RY = m_inBuff.gd.i8RY;
 
-          if( sum == m_inBuff.gd.u16Sum ) {
-            // if the game state has changed, remember when it happend
-            if( m_u8GameState != m_inBuff.gd.u8GameState )
-              m_u32StateChangeTime = millis();
-
-            // update the DriverStation info
-            m_u8GameState = m_inBuff.gd.u8GameState;
-            m_u16Buttons = m_inBuff.gd.u16Buttons;
-            m_u8LTrig = m_inBuff.gd.u8LTrig;
-            m_u8RTrig = m_inBuff.gd.u8RTrig;
-            m_i8LX = m_inBuff.gd.i8LX;
-            m_i8LY = m_inBuff.gd.i8LY;
-            m_i8RX = m_inBuff.gd.i8RX;
-            m_i8RY = m_inBuff.gd.i8RY;
-
-            vWatchDogReset();
-            return true;
-         }
-          else {
-            Serial.print( "Incorrect Checksum : " ); Serial.println( sum, HEX );
+          vWatchDogReset();
+          return true;
+        }
+        else {
+          vCount( m_status.u16BadChecksum );
 #if DS_DEBUG
-            for( uint8_t i = 0; i < sizeof(inBuff); i++ ) {
-              ToHex( szTmp, inBuff.gru8Buff[i] );
-              delay( 10 );
-              Serial.print( '.' );
-            }
-            Serial.println();
-#endif
+          for( uint8_t i = 0; i < sizeof(m_inBuff); i++ ) {
+            ToHex( szTmp, m_inBuff.gru8Buff[i] );
+            delay( 10 );
+            Serial.print( '.' );
           }
+          Serial.println();
+#endif
+          vResync();
         }
       }
     }
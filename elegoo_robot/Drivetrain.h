@@ -3,17 +3,57 @@
 #ifndef DRIVETRAIN_H
 #define DRIVETRAIN_H
 
+#include "Hal.h"
 #include "RobotMap.h"
 #include "TankDriveSide.h"
 #include "WheelEncoder.h"
+#include "VelocityController.h"
+#include "MotionProfile.h"
+#include "Odometry.h"
+#include "FixedPoint.h"
+#include "FastIO.h"
+#include "LineSensors.h"
+#include "EventLog.h"
 
 // Constants
-#define AUTO_STRAIGHT_POWER         144
-#define AUTO_TURN_POWER             224
+#define AUTO_STRAIGHT_SPEED         350   // mm/s
+#define AUTO_TURN_SPEED             300   // mm/s (per wheel)
+#define AUTO_ACCEL                  800   // mm/s/s
 #define LINE_FOLLOW_STRAIGHT_POWER  160
 #define LINE_FOLLOW_TURN_POWER      160
-#define TICKS_TO_MM_FACTOR          (178/905.0) //(109/280.0)
-#define WHEEL_BASE_MM               145.0
+#define LINE_FOLLOW_PD_POWER        220   // Base power for the analog (PD) follower
+#define LINE_FOLLOW_PERIOD_US       5000  // PD rate (200Hz)
+#define LINE_FOLLOW_KP              180   // Steering power with the line under an outer sensor
+#define LINE_FOLLOW_KD              600   // Steering power per LINE_POS_ONE of movement per period
+#define TICKS_PER_MM                (178/905.0) //(109/280.0)
+#define TICKS_TO_MM_FACTOR          TO_Q16(TICKS_PER_MM)
+#define WHEEL_BASE_MM               145
+#define ROTATE_MM_PER_DEG           TO_Q16(WHEEL_BASE_MM * PI / 360)  // Wheel-base circle circumference per degree
+#define HEADING_PER_TICK            ((unsigned long)(ANGLE_FULL_TURN * 256 / (TICKS_PER_MM * WHEEL_BASE_MM * 2 * PI) + 0.5))  // Heading change (Q8) per tick of difference between the sides
+
+// Line sensor pattern bits (set = the sensor sees the black line), see readLineSensors()
+#define LINE_LEFT    0x01
+#define LINE_MIDDLE  0x02
+#define LINE_RIGHT   0x04
+
+// What the line follower does for each pattern
+enum LineActions {
+  lineStraight = 0,
+  lineTurnLeft,     // Bring the line back to the middle
+  lineTurnRight,
+  lineLastTurn,     // Lost the line (probably overshot it), turn hard the way we last turned
+  lineStop          // All three see black: crossing a line
+};
+const uint8_t g_lineFollowActions[8] PROGMEM = {
+  lineLastTurn,     // ---
+  lineTurnLeft,     // L--
+  lineStraight,     // -M-
+  lineStraight,     // LM-
+  lineTurnRight,    // --R
+  lineTurnLeft,     // L-R (left wins, same as it always has)
+  lineStraight,     // -MR
+  lineStop          // LMR
+};
 
 enum States {
   idle = 0,
@@ -28,51 +68,227 @@ private:
   class TankDriveSide m_leftSide;
   class TankDriveSide m_rightSide;
   class WheelEncoder m_leftEncoder;
-  //class WheelEncoder m_rightEncoder;
-  int m_leftEncoderCount;
-  //int m_rightEncoderCount;
+  class WheelEncoder m_rightEncoder;
+  class VelocityController m_leftVelocity;
+  class VelocityController m_rightVelocity;
+  bool m_velocityControl;           // True while setVelocity() is in charge of the motors
+  unsigned long m_nextControlUs;    // When the velocity controllers run next
   int m_leftTargetTicks;
-  //int m_rightTargetTicks;
+  class MotionProfile m_profile;
+  unsigned long m_lastProfileUs;
+  class Odometry m_odometry;
+  int m_odoLeftTicks;               // Encoder counts already added to the odometry
+  int m_odoRightTicks;
+  unsigned long m_rotateStartHeading; // Odometry total heading (Q8) when autoRotate started
+  long m_rotateTarget;                // How far autoRotate should turn (1/65536 turn, Q8)
+  bool m_leftForward;               // Direction of each side for the current auto move
+  bool m_rightForward;
+  bool m_lineLastTurnLeft;          // Line was last seen to the left (for when it loses the line)
+  class LineSensors m_lineSensors;
+  int m_linePosition;               // Last line position (see LineSensors::getPosition())
+  bool m_lineTracking;              // m_linePosition is from the last PD period (for the D term)
+  unsigned long m_nextLineUs;       // When the PD line follower runs next
   enum States m_state;
-  
+
+  ////////////////////////////////////////////////////////////////////
+  // Progress towards the straight drive target (average of both encoders)
+  int getAutoTicks() {
+    return (m_leftEncoder.getDistanceInTicks() + m_rightEncoder.getDistanceInTicks()) / 2;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Add any new encoder ticks to the odometry
+  void updateOdometry() {
+    int left = m_leftEncoder.getDistanceInTicks();
+    int right = m_rightEncoder.getDistanceInTicks();
+    m_odometry.update(left - m_odoLeftTicks, right - m_odoRightTicks);
+    m_odoLeftTicks = left;
+    m_odoRightTicks = right;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Reset the encoders for a new auto move (after handing the last ticks to the odometry)
+  void resetEncoders() {
+    int left = m_leftEncoder.reset();
+    int right = m_rightEncoder.reset();
+    m_odometry.update(left - m_odoLeftTicks, right - m_odoRightTicks);
+    m_odoLeftTicks = 0;
+    m_odoRightTicks = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // How far the robot has turned since autoRotate started, in the direction of the target
+  // (1/65536 turn, Q8)
+  long getRotateProgress() {
+    long turned = (long)(m_odometry.getTotalHeadingQ8() - m_rotateStartHeading);
+    return (m_rotateTarget >= 0) ? turned : -turned;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Convert a heading change (1/65536 turn, Q8) to degrees (rounded)
+  static int headingToDeg(long headingQ8) {
+    return ((headingQ8 >> 8) * 360 + (ANGLE_FULL_TURN / 2)) >> 16;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Start the motion profile for an auto move of distanceMm (per wheel)
+  void startProfile(int distanceMm, int maxSpeed) {
+    m_profile.start(distanceMm, maxSpeed, AUTO_ACCEL);
+    m_lastProfileUs = micros();
+    setProfileSpeed(m_profile.getSpeed(0));
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Update the auto move's speed from the profile (at the velocity control rate, there's no
+  // point doing it more often)
+  void updateProfile(int travelledMm) {
+    unsigned long now = micros();
+    if((now - m_lastProfileUs) < VELOCITY_PERIOD_US) {
+      return;
+    }
+    m_lastProfileUs = now;
+    setProfileSpeed(m_profile.getSpeed(travelledMm));
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Apply a profile speed in the direction of the current auto move
+  void setProfileSpeed(int speed) {
+    setVelocity(m_leftForward ? speed : -speed, m_rightForward ? speed : -speed);
+  }
+
 public:
   // Constructor
   Drivetrain(): 
     m_leftSide(),
     m_rightSide(),
-    m_leftEncoder()
-    /*m_rightEncoder()*/ {}
+    m_leftEncoder(),
+    m_rightEncoder(),
+    m_leftVelocity(),
+    m_rightVelocity() {}
 
 
   ////////////////////////////////////////////////////////////////////
   // Initializer (constructor wasn't a good place to do this)
   void init() {
-    // Only using the left encoder to measure distance so right is disabled
-    
-    m_leftSide.init(L298_ENA_PIN, L298_IN1_PIN, L298_IN2_PIN);
-    m_rightSide.init(L298_ENB_PIN, L298_IN4_PIN, L298_IN3_PIN);
+    m_leftSide.init<L298_IN1_PIN, L298_IN2_PIN>(L298_ENA_PIN);
+    m_rightSide.init<L298_IN4_PIN, L298_IN3_PIN>(L298_ENB_PIN);
     m_leftEncoder.init(LEFT_WHEEL_ENCODER_PIN, true);
-//    m_rightEncoder.init(RIGHT_WHEEL_ENCODER_PIN, false);
+    m_rightEncoder.init(RIGHT_WHEEL_ENCODER_PIN, false);
 
     pinMode(LINE_LEFT_PIN, INPUT);
     pinMode(LINE_MIDDLE_PIN, INPUT);
     pinMode(LINE_RIGHT_PIN, INPUT);
     
     m_leftEncoder.setTicksToDistanceFactor(TICKS_TO_MM_FACTOR);
-//    m_rightEncoder.setTicksToDistanceFactor(TICKS_TO_MM_FACTOR);
+    m_rightEncoder.setTicksToDistanceFactor(TICKS_TO_MM_FACTOR);
+    m_leftVelocity.init(&m_leftSide, &m_leftEncoder);
+    m_rightVelocity.init(&m_rightSide, &m_rightEncoder);
+    m_velocityControl = false;
+    m_nextControlUs = micros();
     m_leftTargetTicks = 0;
-//    m_rightTargetTicks = 0;
+    m_odometry.init(m_leftEncoder.getMmPerTickQ12(), HEADING_PER_TICK);
+    m_odoLeftTicks = 0;
+    m_odoRightTicks = 0;
+    m_rotateStartHeading = 0;
+    m_rotateTarget = 0;
+    m_leftForward = true;
+    m_lineLastTurnLeft = false;
+    m_linePosition = 0;
+    m_lineTracking = false;
+    m_nextLineUs = micros();
+#ifndef DIGITAL_LINE_FOLLOWER
+    m_lineSensors.init();
+#endif
+    m_rightForward = true;
     m_state = idle;
     setPower(0, 0);
   }
 
   ////////////////////////////////////////////////////////////////////
-  // Set left and right side power (0..255)
+  // Set left and right side power (0..255).  Open loop, stops any velocity control.
+  // The encoders can't tell direction, so they count the way each side was last driven.  A
+  // stop leaves that alone: the wheels coast on the same way for a while.
   void setPower(int left, int right) {
+    m_velocityControl = false;
     m_leftSide.setPower(left);
     m_rightSide.setPower(right);
-    m_leftEncoder.setDirectionForward(left > 0 ? true : false);
-//    m_rightEncoder.setDirectionForward(right > 0 ? true : false);
+    if(left != 0) {
+      m_leftEncoder.setDirectionForward(left > 0);
+    }
+    if(right != 0) {
+      m_rightEncoder.setDirectionForward(right > 0);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Set left and right side speeds (mm/s).  Closed loop, the controllers run from update()
+  // until the next setPower().
+  void setVelocity(int leftMmps, int rightMmps) {
+    m_leftVelocity.setTarget(leftMmps);
+    m_rightVelocity.setTarget(rightMmps);
+    if(!m_velocityControl) {
+      m_velocityControl = true;
+      m_nextControlUs = micros();
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Update the odometry and run the velocity controllers if one is due.  Call every loop.
+  // The controllers run every VELOCITY_PERIOD_US no matter how long the loop is.  If the loop
+  // stalls for more than a period the missed ones are dropped rather than run back to back.
+  void update() {
+    updateOdometry();
+    if(!m_velocityControl) {
+      return;
+    }
+    unsigned long now = micros();
+    if((long)(now - m_nextControlUs) < 0) {
+      return;
+    }
+    m_nextControlUs += VELOCITY_PERIOD_US;
+    if((long)(now - m_nextControlUs) >= 0) {
+      m_nextControlUs = now + VELOCITY_PERIOD_US;
+    }
+    m_leftVelocity.update();
+    m_rightVelocity.update();
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Pose estimate (see Odometry.h for the field coordinates)
+  Odometry &getOdometry() {
+    return m_odometry;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Wheel speeds (Q4 mm/s, see WheelEncoder::getVelocityMmPerSec())
+  long getLeftVelocity() {
+    return m_leftEncoder.getVelocityMmPerSec();
+  }
+  long getRightVelocity() {
+    return m_rightEncoder.getVelocityMmPerSec();
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Encoder counts (reset at the start of each auto move) and motor powers, for diagnostics
+  int getLeftTicks() {
+    return m_leftEncoder.getDistanceInTicks();
+  }
+  int getRightTicks() {
+    return m_rightEncoder.getDistanceInTicks();
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // How far the robot has turned since autoRotate started, as ticks of both sides added
+  // together (see rotateTicksToDeg()).  Includes the coast after abortAuto(): the encoders keep
+  // the direction of the turn until the next non-zero power.
+  int getRotateTicks() {
+    return abs(getLeftTicks()) + abs(getRightTicks());
+  }
+  int getLeftPower() {
+    return m_leftSide.getPower();
+  }
+  int getRightPower() {
+    return m_rightSide.getPower();
   }
 
   ////////////////////////////////////////////////////////////////////
@@ -116,6 +332,7 @@ public:
   // Update the auto-drive state machine (for motion when not using joysticks)
   void updateAuto() {
     int ticks = 0;
+    long turned = 0;
     
     switch(m_state) {
     case idle:
@@ -123,47 +340,46 @@ public:
       
     case straight:
       // Check if we've gotten to the target distance (take into account the direction)
-      ticks = m_leftEncoder.getDistanceInTicks();
+      ticks = getAutoTicks();
       if((m_leftTargetTicks >= 0 && (ticks >= m_leftTargetTicks)) ||
          (m_leftTargetTicks < 0 && (ticks <= m_leftTargetTicks))) {
         setPower(0, 0);
         m_state = idle;
-        Serial.print("Ending straight drive (");
-        Serial.print(ticks);
-        Serial.print(" of ");
-        Serial.print(m_leftTargetTicks);
-        Serial.print(" P:");
-        Serial.print(getPollCount());
-        Serial.println(")");
+        g_log.log(logStraightDone, ticks, m_leftTargetTicks, m_leftEncoder.getDistanceInTicks(),
+                  m_rightEncoder.getDistanceInTicks());
+      }
+      else {
+        updateProfile(m_leftEncoder.getDistanceOfTicks(m_leftForward ? ticks : -ticks));
       }
       break;
       
     case rotate:
-      // Check if we've gotten to the target distance (take into account the direction)
-      ticks = m_leftEncoder.getDistanceInTicks();
-      if((m_leftTargetTicks >= 0 && (ticks >= m_leftTargetTicks)) ||
-         (m_leftTargetTicks < 0 && (ticks <= m_leftTargetTicks))) {
+      // Check if we've turned to the target heading (odometry, so both wheels count).  A tick
+      // on each side is the finest step the encoders can see, so stop within half of that.
+      updateOdometry();
+      turned = getRotateProgress();
+      if(turned >= labs(m_rotateTarget) - (long)HEADING_PER_TICK) {
         setPower(0, 0);
         m_state = idle;
-        Serial.print("Ending rotate (");
-        Serial.print(ticks);
-        Serial.print(" of ");
-        Serial.print(m_leftTargetTicks);
-        Serial.print(" P:");
-        Serial.print(getPollCount());
-        Serial.println(")");
+        g_log.log(logRotateDone, headingToDeg(turned), headingToDeg(labs(m_rotateTarget)),
+                  m_leftEncoder.getDistanceInTicks(), m_rightEncoder.getDistanceInTicks());
+      }
+      else {
+        updateProfile(rotateDegToMm(headingToDeg(turned)));
       }
       break;
 
     case driveToLine:
-      if(digitalRead(LINE_MIDDLE_PIN) == 0) {
+      if(readLineSensors() & LINE_MIDDLE) {
         setPower(0, 0);
         m_state = idle;
       }
       break;
 
     case lineFollower:
-      autoLineFollow();
+      if(autoLineFollow()) {
+        m_state = idle;
+      }
       break;
 
     }
@@ -179,6 +395,7 @@ public:
   // Aborts an auto maneuver
   void abortAuto() {
     m_state = idle;
+    m_lineTracking = false;
     setPower(0, 0);
   }
 
@@ -194,24 +411,31 @@ public:
     
     // Set target distance in encoder ticks
     m_leftTargetTicks = m_leftEncoder.getNumTicksInDistance(distance);
-//    m_rightTargetTicks = m_rightEncoder.getNumTicksInDistance(distance);
 
     // Reset the encoders and set the direction of motion
-    m_leftEncoder.reset();
-//    m_rightEncoder.reset();
+    resetEncoders();
+    m_leftForward = (distance > 0);
+    m_rightForward = m_leftForward;
 
-    // Start the motors
-    if(distance > 0) {
-      setPower(AUTO_STRAIGHT_POWER,AUTO_STRAIGHT_POWER);
-    }
-    else {
-      setPower(-AUTO_STRAIGHT_POWER,-AUTO_STRAIGHT_POWER);
-    }
+    // Start the motors (the profile ramps them up and down from updateAuto())
+    startProfile(m_leftEncoder.getDistanceOfTicks(m_leftTargetTicks), AUTO_STRAIGHT_SPEED);
 
     // Start the state machine
     m_state = straight;  
   }
 
+  ////////////////////////////////////////////////////////////////////
+  // Distance each wheel travels to rotate the robot deg degrees in place
+  static int rotateDegToMm(int deg) {
+    return mulShift(deg, ROTATE_MM_PER_DEG, 16);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Degrees turned in place for a number of getRotateTicks() ticks
+  static int rotateTicksToDeg(int ticks) {
+    return headingToDeg((long)ticks * HEADING_PER_TICK);
+  }
+
   ////////////////////////////////////////////////////////////////////
   // Auto Rotate (in deg, negative means counter-clockwise)
   void autoRotate(int deg) {
@@ -222,30 +446,21 @@ public:
       return;
     }
 
-    // Convert degress to distance (based on wheel-base's circle circumference)
-    int distance = WHEEL_BASE_MM * PI * (long)deg / 360;
+    // The rotation ends on the odometry heading.  The profile works on the distance each wheel
+    // travels (based on wheel-base's circle circumference).
+    int distance = rotateDegToMm(deg);
+    m_rotateTarget = DEG_TO_ANGLE(deg) << 8;
 
-    // Set the target ticks
-    m_leftTargetTicks = m_leftEncoder.getNumTicksInDistance(distance);
-//    m_rightTargetTicks = m_rightEncoder.getNumTicksInDistance(distance);
-
-    Serial.print("AutoRotate: ");
-    Serial.print(deg);
-    Serial.print("deg=");
-    Serial.print(m_leftTargetTicks);
-    Serial.println("ticks");
+    g_log.log(logRotateStart, deg, distance);
 
     // Reset the encoders and set the direction of motion
-    m_leftEncoder.reset();
-//    m_rightEncoder.reset();
+    resetEncoders();
+    m_rotateStartHeading = m_odometry.getTotalHeadingQ8();
+    m_leftForward = (deg > 0);
+    m_rightForward = !m_leftForward;
 
-    // Start the motors
-    if(distance > 0) {
-      setPower(AUTO_TURN_POWER, -AUTO_TURN_POWER);
-    }
-    else {
-      setPower(-AUTO_TURN_POWER, AUTO_TURN_POWER);
-    }
+    // Start the motors (the profile ramps them up and down from updateAuto())
+    startProfile(distance, AUTO_TURN_SPEED);
 
     // Start the state machine
     m_state = rotate;  
@@ -259,40 +474,124 @@ public:
   }
 
   ////////////////////////////////////////////////////////////////////
-  // Follow a black line.  This should be called as often as possible.
-  // Note:  This auto doesn't follow the same structure as the others.
-  void autoLineFollow() {
-    static bool lastTurnLeft = false;
-    
-    // Check if all three sensors see black (perpendicular to a black line)
-    if((digitalRead(LINE_LEFT_PIN) == 0) && 
-       (digitalRead(LINE_MIDDLE_PIN) == 0) && 
-       (digitalRead(LINE_RIGHT_PIN) == 0)) {
-      setPower(0, 0);  
+  // Read the three line sensors at once (LINE_* bits).  They're all on port C, so one port read
+  // samples them at the same instant and the follower never sees a mix of two positions.
+  uint8_t readLineSensors() {
+    typedef FastPin<LINE_LEFT_PIN> Left;
+    typedef FastPin<LINE_MIDDLE_PIN> Middle;
+    typedef FastPin<LINE_RIGHT_PIN> Right;
+    static_assert(Left::PORT == Middle::PORT && Middle::PORT == Right::PORT,
+                  "The line sensors have to be on the same port");
+
+    // Sensors read 0 over the black line
+    uint8_t in = FastPort<Left::PORT>::read(Left::MASK | Middle::MASK | Right::MASK);
+    uint8_t pattern = 0;
+    if(!(in & Left::MASK)) {
+      pattern |= LINE_LEFT;
     }
-    if(digitalRead(LINE_MIDDLE_PIN) == 0) {
-      // Black line is in the middle, keep going
-      setPower(LINE_FOLLOW_STRAIGHT_POWER, LINE_FOLLOW_STRAIGHT_POWER);
+    if(!(in & Middle::MASK)) {
+      pattern |= LINE_MIDDLE;
     }
-    else if(digitalRead(LINE_LEFT_PIN) == 0) {
-      // Black line is under the left sensor to go left to bring it to the middle
-      setPower(-LINE_FOLLOW_TURN_POWER, LINE_FOLLOW_TURN_POWER);
-      lastTurnLeft = true;
+    if(!(in & Right::MASK)) {
+      pattern |= LINE_RIGHT;
     }
-    else if(digitalRead(LINE_RIGHT_PIN) == 0) {
-      // Black line is under the right sensor to go right to bring it to the middle
-      setPower(LINE_FOLLOW_TURN_POWER, -LINE_FOLLOW_TURN_POWER);
-      lastTurnLeft = false;
+    return pattern;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Follow a black line.  This should be called as often as possible.  Returns true (with the
+  // motors stopped) when all three sensors see black, i.e. the robot is crossing a line.
+  // Note:  This auto doesn't follow the same structure as the others.
+  bool autoLineFollow() {
+#ifdef DIGITAL_LINE_FOLLOWER
+    return lineFollowDigital();
+#else
+    return lineFollowAnalog();
+#endif
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Steer with a PD controller on the line position from the analog readings.  Runs every
+  // LINE_FOLLOW_PERIOD_US (on a new set of readings), the rest of the calls just return.
+  bool lineFollowAnalog() {
+    unsigned long now = micros();
+    uint16_t values[LINE_CHANNELS];
+    if((long)(now - m_nextLineUs) < 0 || !m_lineSensors.read(values)) {
+      return false;
     }
-    else {
-      // Probably overshot the line, turn hard towards where we were turning before
-      if(lastTurnLeft) {
+    m_nextLineUs += LINE_FOLLOW_PERIOD_US;
+    if((long)(now - m_nextLineUs) >= 0) {
+      // Fell behind (or wasn't following), don't try to catch up.  The last position is too
+      // old for the D term.
+      m_nextLineUs = now + LINE_FOLLOW_PERIOD_US;
+      m_lineTracking = false;
+    }
+
+    int position;
+    bool crossing;
+    if(!LineSensors::getPosition(values, &position, &crossing)) {
+      // Probably overshot the line, turn hard towards where it was last seen
+      m_lineTracking = false;
+      if(m_lineLastTurnLeft) {
         setPower(-LINE_FOLLOW_TURN_POWER, LINE_FOLLOW_TURN_POWER);
       }
       else {
         setPower(LINE_FOLLOW_TURN_POWER, -LINE_FOLLOW_TURN_POWER);
       }
+      return false;
+    }
+    if(crossing) {
+      setPower(0, 0);
+      return true;
+    }
+
+    // Positive position (line to the right) speeds up the left side.  LINE_POS_ONE is 1 << 8.
+    // No D term on the first period after a start or after finding the line again.  Steering
+    // is limited so the slow side stops at worst instead of spinning the robot in place.
+    if(!m_lineTracking) {
+      m_linePosition = position;
+      m_lineTracking = true;
+    }
+    int steer = ((long)LINE_FOLLOW_KP * position +
+                 (long)LINE_FOLLOW_KD * (position - m_linePosition)) >> 8;
+    if(steer > LINE_FOLLOW_PD_POWER) {
+      steer = LINE_FOLLOW_PD_POWER;
+    }
+    else if(steer < -LINE_FOLLOW_PD_POWER) {
+      steer = -LINE_FOLLOW_PD_POWER;
+    }
+    m_linePosition = position;
+    m_lineLastTurnLeft = (position < 0);
+    setPower(LINE_FOLLOW_PD_POWER + steer, LINE_FOLLOW_PD_POWER - steer);
+    return false;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Bang-bang follower on the digital sensor pattern (DIGITAL_LINE_FOLLOWER, for sensor boards
+  // without analog outputs)
+  bool lineFollowDigital() {
+    uint8_t action = pgm_read_byte(&g_lineFollowActions[readLineSensors()]);
+    if(action == lineLastTurn) {
+      action = m_lineLastTurnLeft ? lineTurnLeft : lineTurnRight;
+    }
+
+    switch(action) {
+    case lineStraight:
+      setPower(LINE_FOLLOW_STRAIGHT_POWER, LINE_FOLLOW_STRAIGHT_POWER);
+      break;
+    case lineTurnLeft:
+      setPower(-LINE_FOLLOW_TURN_POWER, LINE_FOLLOW_TURN_POWER);
+      m_lineLastTurnLeft = true;
+      break;
+    case lineTurnRight:
+      setPower(LINE_FOLLOW_TURN_POWER, -LINE_FOLLOW_TURN_POWER);
+      m_lineLastTurnLeft = false;
+      break;
+    default:
+      setPower(0, 0);
+      return true;
     }
+    return false;
   }
 };
 
@@ -1,32 +1,98 @@
 // Elevator subsystem
 // Includes continuous servo control for raise-lower functionality and upper and lower limit switches.
+// The limit switches are on pin change interrupts: the ISR stops the servo as soon as the
+// elevator reaches the limit it's being driven towards, however long the loop happens to be
+// stuck elsewhere.  The stop is latched until the elevator is driven the other way, so the
+// command handlers see it on their next check even if the switch bounces open again.
+//
+// There's no encoder on the elevator, so the height is estimated by integrating the commanded
+// servo speed over time, and reset whenever a limit switch is closed.  moveTo() uses that to
+// stop at heights in between, slowing down as it gets close.
 #ifndef ELEVATOR_H
 #define ELEVATOR_H
 
+#include "Hal.h"
 #include "RobotMap.h"
-#include <Servo.h>
+#include "FastIO.h"
+#include "PwmServo.h"
+
+#define ELEVATOR_SERVO_STOP   90    // Continuous servo angle for full-stop
+
+// Position model and moveTo()
+#define ELEVATOR_STROKE_MM      120     // Lower to upper limit
+#define ELEVATOR_MM_PER_SEC     60      // At full power
+#define ELEVATOR_SLOW_ZONE_MM   15      // Ramp the power down over this distance from the target
+#define ELEVATOR_MIN_POWER      64      // Slowest approach (the servo barely turns below this)
+#define ELEVATOR_TOLERANCE_MM   2       // Close enough to the target
+#define ELEVATOR_MAX_DT_US      100000  // Longest gap integrated at once (keeps the math in range)
+
+// ElevatorIsrState::stoppedAt bits
+#define ELEVATOR_AT_LOWER     0x01
+#define ELEVATOR_AT_UPPER     0x02
+
+// State shared with the limit switch ISR (the interrupts don't work with class functions)
+struct ElevatorIsrState {
+  PwmServo *pServo;
+  volatile int8_t direction;    // Direction being driven (1 = up, -1 = down, 0 = stopped)
+  volatile uint8_t stoppedAt;   // ELEVATOR_AT_* limit the ISR stopped the elevator at
+};
+ElevatorIsrState g_elevator = { NULL, 0, 0 };
+
+// Switches are wired to read 1 when the elevator is at the limit
+inline uint8_t readElevatorLimits() {
+  uint8_t limits = 0;
+  if(FastPin<ELEVATOR_LOWER_LIMIT_SWITCH_PIN>::read()) {
+    limits |= ELEVATOR_AT_LOWER;
+  }
+  if(FastPin<ELEVATOR_UPPER_LIMIT_SWITCH_PIN>::read()) {
+    limits |= ELEVATOR_AT_UPPER;
+  }
+  return limits;
+}
+
+// Both limit switches (pin change, either edge).  Only stops the elevator if it's being driven
+// into the switch that closed, so driving off a limit still works.
+void elevatorLimitIsr(void) {
+  uint8_t limits = readElevatorLimits();
+  uint8_t hit = (g_elevator.direction > 0) ? (limits & ELEVATOR_AT_UPPER) :
+                (g_elevator.direction < 0) ? (limits & ELEVATOR_AT_LOWER) : 0;
+  if(hit) {
+    g_elevator.pServo->write(ELEVATOR_SERVO_STOP);
+    g_elevator.direction = 0;
+    g_elevator.stoppedAt = hit;
+  }
+}
+
 
 class Elevator {
 private:
-  Servo raiseLowerServo;
-public:
-  ////////////////////////////////////////////////////////////////////
-  // Constructor
-  Elevator() {}
+  PwmServo raiseLowerServo;
+  int m_power;
+  long m_positionUm;            // Estimated height (um above the lower limit)
+  long m_residual;              // Travel not yet in m_positionUm (1/256000 um)
+  bool m_calibrated;            // A limit switch has set the height since power-up
+  unsigned long m_lastUpdateUs;
+  int m_targetMm;
+  bool m_moving;                // moveTo() is in charge of the power
 
   ////////////////////////////////////////////////////////////////////
-  // Initializer (constructor wasn't a good place to do this)
-  void init() {
-    pinMode(ELEVATOR_LOWER_LIMIT_SWITCH_PIN, INPUT_PULLUP);
-    pinMode(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, INPUT_PULLUP);
-    raiseLowerServo.attach(ELEVATOR_SERVO_PIN);
-    setPower(0);
-  }
-  
-  ////////////////////////////////////////////////////////////////////
-  // Set the elevator power (-256 to 256, negative is down)
-  void setPower(int power) {
+  // Set the servo for a power (-256 to 256, negative is down).  Power into a limit the elevator
+  // is already at is ignored.
+  void drive(int power) {
     int servoPower;
+
+    // Done with interrupts off so the ISR can't stop the elevator in between here and the
+    // servo write below
+    noInterrupts();
+    uint8_t limits = readElevatorLimits() | g_elevator.stoppedAt;
+    if((power > 0 && (limits & ELEVATOR_AT_UPPER)) || (power < 0 && (limits & ELEVATOR_AT_LOWER))) {
+      power = 0;
+    }
+    if(power != 0) {
+      g_elevator.stoppedAt = 0;
+    }
+    g_elevator.direction = (power > 0) ? 1 : ((power < 0) ? -1 : 0);
+    m_power = power;
     
     // Map values to servo speeds
     // - -256..0 = servo 90 to 180
@@ -35,32 +101,166 @@ public:
       // Lower elevator
       servoPower = -power * 90;
       servoPower >>= 8; // divide by 256
-      servoPower = 90 + servoPower;   
+      servoPower = ELEVATOR_SERVO_STOP + servoPower;   
     }
     else if(power > 0) {
       // Raise elevator
       servoPower = power * 90;
       servoPower >>= 8; // divide by 256
-      servoPower = 90 - servoPower;
+      servoPower = ELEVATOR_SERVO_STOP - servoPower;
     }
     else {
-      servoPower = 90;  // Full-stop on continuous servo
+      servoPower = ELEVATOR_SERVO_STOP;  // Full-stop on continuous servo
     }
     raiseLowerServo.write(servoPower);
+    interrupts();
+  }
+
+public:
+  ////////////////////////////////////////////////////////////////////
+  // Constructor
+  Elevator() {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Initializer (constructor wasn't a good place to do this)
+  void init() {
+    pinMode(ELEVATOR_LOWER_LIMIT_SWITCH_PIN, INPUT_PULLUP);
+    pinMode(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, INPUT_PULLUP);
+    raiseLowerServo.attach(ELEVATOR_SERVO_PIN);
+    g_elevator.pServo = &raiseLowerServo;
+    m_positionUm = 0;
+    m_residual = 0;
+    m_calibrated = false;
+    m_lastUpdateUs = micros();
+    m_targetMm = 0;
+    setPower(0);
+    attachPinChangeInterrupt(ELEVATOR_LOWER_LIMIT_SWITCH_PIN, elevatorLimitIsr, CHANGE);
+    attachPinChangeInterrupt(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, elevatorLimitIsr, CHANGE);
+  }
+  
+  ////////////////////////////////////////////////////////////////////
+  // Set the elevator power (-256 to 256, negative is down).  Cancels a moveTo().  Power into a
+  // limit the elevator is already at is ignored.
+  void setPower(int power) {
+    m_moving = false;
+    drive(power);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Get the power last set (-256 to 256).  0 once a limit switch has stopped the elevator.
+  int getPower() {
+    return g_elevator.direction ? m_power : 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Start moving to a height (mm above the lower limit).  isMoving() goes false once it's
+  // there.  If the height isn't known yet (no limit switch since power-up) the elevator goes
+  // down to the lower limit first.
+  void moveTo(int heightMm) {
+    m_targetMm = heightMm;
+    m_moving = true;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // True while a moveTo() is under way
+  bool isMoving() {
+    return m_moving;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Estimated height (mm above the lower limit).  Only meaningful once isCalibrated().
+  int getHeightMm() {
+    return m_positionUm / 1000;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // True once a limit switch has set the height
+  bool isCalibrated() {
+    return m_calibrated;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Update the height estimate and run moveTo().  Call every loop.
+  void update() {
+    unsigned long now = micros();
+    unsigned long dtUs = now - m_lastUpdateUs;
+    m_lastUpdateUs = now;
+    if(dtUs > ELEVATOR_MAX_DT_US) {
+      dtUs = ELEVATOR_MAX_DT_US;
+    }
+
+    // Integrate the commanded speed, then let the limit switches pin it down.  A loop is only
+    // a fraction of a um at slow speeds, so the remainder is carried to the next update rather
+    // than dropped (which would make the estimate read low, more so the faster the loop runs).
+    long travel = (long)getPower() * ELEVATOR_MM_PER_SEC * (long)dtUs + m_residual;
+    m_positionUm += travel / 256000;
+    m_residual = travel % 256000;
+    uint8_t limits = readElevatorLimits() | g_elevator.stoppedAt;
+    if(limits & ELEVATOR_AT_LOWER) {
+      m_positionUm = 0;
+      m_residual = 0;
+      m_calibrated = true;
+    }
+    else if(limits & ELEVATOR_AT_UPPER) {
+      m_positionUm = ELEVATOR_STROKE_MM * 1000L;
+      m_residual = 0;
+      m_calibrated = true;
+    }
+    else if(m_positionUm < 0) {
+      m_positionUm = 0;
+      m_residual = 0;
+    }
+    else if(m_positionUm > ELEVATOR_STROKE_MM * 1000L) {
+      m_positionUm = ELEVATOR_STROKE_MM * 1000L;
+      m_residual = 0;
+    }
+
+    if(!m_moving) {
+      return;
+    }
+    if(!m_calibrated) {
+      // Find the bottom first
+      drive(-256);
+      return;
+    }
+
+    // Done when close enough, or stopped at a limit on the way.  A target at either end only
+    // counts once the switch closes (so ElevatorTo the top is as good as ElevatorToTop).
+    long errorUm = m_targetMm * 1000L - m_positionUm;
+    bool atEnd = (m_targetMm <= 0 || m_targetMm >= ELEVATOR_STROKE_MM);
+    if((!atEnd && labs(errorUm) <= ELEVATOR_TOLERANCE_MM * 1000L) ||
+       (errorUm >= 0 && (limits & ELEVATOR_AT_UPPER)) || (errorUm <= 0 && (limits & ELEVATOR_AT_LOWER))) {
+      drive(0);
+      m_moving = false;
+      return;
+    }
+
+    // Full power, ramping down to ELEVATOR_MIN_POWER over the slow zone
+    if(errorUm == 0) {
+      errorUm = (m_targetMm > 0) ? 1 : -1;   // At an end by the estimate, keep going for the switch
+    }
+    long power = labs(errorUm) * 256 / (ELEVATOR_SLOW_ZONE_MM * 1000L);
+    if(power > 256) {
+      power = 256;
+    }
+    else if(power < ELEVATOR_MIN_POWER) {
+      power = ELEVATOR_MIN_POWER;
+    }
+    drive((errorUm > 0) ? (int)power : -(int)power);
   }
 
   ////////////////////////////////////////////////////////////////////
-  // Returns true of elevator is at the lower limit
+  // Returns true of elevator is at the lower limit (the switch is closed, or the ISR stopped the
+  // elevator there)
   bool isAtLowerLimit() {
-    // Switch is wired to read 1 when elevator is at the limit
-    return digitalRead(ELEVATOR_LOWER_LIMIT_SWITCH_PIN);
+    return (readElevatorLimits() | g_elevator.stoppedAt) & ELEVATOR_AT_LOWER;
   }
 
   ////////////////////////////////////////////////////////////////////
-  // Returns true of elevator is at the upper limit
+  // Returns true of elevator is at the upper limit (the switch is closed, or the ISR stopped the
+  // elevator there)
   bool isAtUpperLimit() {
-    // Switch is wired to read 1 when elevator is at the limit
-    return digitalRead(ELEVATOR_UPPER_LIMIT_SWITCH_PIN);
+    return (readElevatorLimits() | g_elevator.stoppedAt) & ELEVATOR_AT_UPPER;
   }
 };
 
@@ -0,0 +1,121 @@
+// Event log
+// Fixed-size binary records in a RAM ring buffer, sent over Serial in the loop's spare time.
+// - log() only fills in a 14-byte record, so it's cheap enough to call from the control code
+//   (updateAuto(), the command handlers).
+// - service() sends at most one record per loop, and only if it fits in the Serial TX buffer,
+//   so logging never blocks the loop.  It's fine to leave on in competition builds.
+// - If the ring is full the record is dropped and counted.  The count goes out as a logDropped
+//   record once there's room again.
+// Records are framed like the telemetry packets (preamble, 16-bit byte sum) and are decoded on
+// the host with host/build/telemetry_decode -l.
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include "Hal.h"
+
+#define LOG_PREAMBLE  0x5B  // Telemetry uses 0x5A, DriverStation 0xA5
+#define LOG_RECORDS   8     // Ring size (14 bytes each)
+
+// Events and their data (keep host/TelemetryDecoder.h in step)
+enum LogEvents {
+  logTrace = 0,       // Source line, value
+  logDropped,         // Number of records dropped
+  logStraightDone,    // Ticks, target ticks, left ticks, right ticks
+  logRotateStart,     // deg, mm per wheel
+  logRotateDone,      // Turned deg, target deg, left ticks, right ticks
+  logUltrasonic,      // Ultrasonic reading (mm)
+  logCupScan,         // Centre ticks, scan end ticks, angle to the cup (deg), distance (mm)
+  logCupPosition,     // Field x, y (mm)
+  logNoCommandSlot,   // (none)
+  NUM_LOG_EVENTS
+};
+
+struct LogRecord {
+  uint8_t   u8Preamble;
+  uint8_t   u8Event;
+  uint16_t  u16TimeMs;    // millis() (low 16 bits)
+  int16_t   i16Data[4];
+  uint16_t  u16Sum;
+};
+
+
+class EventLog {
+private:
+  LogRecord m_records[LOG_RECORDS];
+  uint8_t m_head;     // Next record to send
+  uint8_t m_count;    // Records waiting
+  uint8_t m_dropped;  // Records dropped since the last logDropped (saturates)
+
+  ////////////////////////////////////////////////////////////////////
+  // Add a record to the ring (caller checks there's room)
+  void push(uint8_t event, int a, int b, int c, int d) {
+    uint8_t idx = m_head + m_count;
+    if(idx >= LOG_RECORDS) {
+      idx -= LOG_RECORDS;
+    }
+    LogRecord &rec = m_records[idx];
+    rec.u8Preamble = LOG_PREAMBLE;
+    rec.u8Event = event;
+    rec.u16TimeMs = millis();
+    rec.i16Data[0] = a;
+    rec.i16Data[1] = b;
+    rec.i16Data[2] = c;
+    rec.i16Data[3] = d;
+
+    const uint8_t *pBytes = (const uint8_t *)&rec;
+    uint16_t sum = 0;
+    for(uint8_t i = 0; i < sizeof(LogRecord) - 2; i++) {
+      sum += pBytes[i];
+    }
+    rec.u16Sum = sum;
+    m_count++;
+  }
+
+public:
+  EventLog() : m_head(0), m_count(0), m_dropped(0) {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Log an event (see LogEvents for what the data means)
+  void log(uint8_t event, int a = 0, int b = 0, int c = 0, int d = 0) {
+    if(m_count >= LOG_RECORDS) {
+      if(m_dropped != 0xff) {
+        m_dropped++;
+      }
+      return;
+    }
+    push(event, a, b, c, d);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Log a source line (the TRACE macro)
+  void trace(int line, int value) {
+    log(logTrace, line, value);
+  }
+  void trace(int line, const char *pText) {
+    log(logTrace, line);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Send the oldest record if there's room in the Serial TX buffer.  Call every loop.
+  void service() {
+    if(m_dropped && m_count < LOG_RECORDS) {
+      push(logDropped, m_dropped, 0, 0, 0);
+      m_dropped = 0;
+    }
+    if(m_count == 0 || Serial.availableForWrite() < (int)sizeof(LogRecord)) {
+      return;
+    }
+    Serial.write((const uint8_t *)&m_records[m_head], sizeof(LogRecord));
+    if(++m_head >= LOG_RECORDS) {
+      m_head = 0;
+    }
+    m_count--;
+  }
+};
+
+EventLog g_log;
+
+// Log the source line and a value (or just the line for text)
+#define TRACE(x)  g_log.trace(__LINE__, x)
+
+#endif
@@ -0,0 +1,110 @@
+// Fast digital I/O
+// digitalRead() and digitalWrite() look the pin up in flash tables, check whether it has PWM
+// on it and (for writes) turn interrupts off around the port update, every call: ~3-4us on the
+// Uno.  FastPin<pin> does the lookup at compile time, so a read is a single IN/SBIS and a write
+// a single SBI/CBI (which is atomic, so no interrupt juggling either).
+// - The pin has to be a compile-time constant (the RobotMap.h pins).
+// - pinMode() is still the Arduino one; it's only called from init().
+// - Writes don't turn off PWM the way digitalWrite() does, so don't use FastPin on a pin that
+//   also gets analogWrite().
+// On the host the calls go to the host HAL (which counts them, see the summary elegoo_host
+// prints) so the simulator sees the pins.  Define SLOW_IO in RobotMap.h to send everything
+// through digitalRead()/digitalWrite() again, e.g. to compare loop timing with LOOP_PROFILER.
+#ifndef FASTIO_H
+#define FASTIO_H
+
+#include "Hal.h"
+#include "RobotMap.h"
+
+// Ports on the Uno (ATmega328P)
+enum FastIoPorts {
+  fastIoPortB,  // Pins 8-13
+  fastIoPortC,  // A0-A5 (14-19)
+  fastIoPortD   // Pins 0-7
+};
+
+template<uint8_t PIN>
+struct FastPin {
+  static_assert(PIN < 20, "FastPin only knows the Uno's pins");
+  static const uint8_t PORT = (PIN < 8) ? fastIoPortD : ((PIN < 14) ? fastIoPortB : fastIoPortC);
+  static const uint8_t BIT = (PIN < 8) ? PIN : ((PIN < 14) ? PIN - 8 : PIN - 14);
+  static const uint8_t MASK = 1 << BIT;
+
+#if defined(SLOW_IO)
+  static inline uint8_t read() {
+    return digitalRead(PIN);
+  }
+  static inline void high() {
+    digitalWrite(PIN, HIGH);
+  }
+  static inline void low() {
+    digitalWrite(PIN, LOW);
+  }
+#elif defined(__AVR__)
+  // The port is a constant, so these fold down to the register itself
+  static inline volatile uint8_t &outReg() {
+    return (PORT == fastIoPortD) ? PORTD : ((PORT == fastIoPortB) ? PORTB : PORTC);
+  }
+  static inline volatile uint8_t &inReg() {
+    return (PORT == fastIoPortD) ? PIND : ((PORT == fastIoPortB) ? PINB : PINC);
+  }
+
+  static inline uint8_t read() {
+    return (inReg() & MASK) ? HIGH : LOW;
+  }
+  static inline void high() {
+    outReg() |= MASK;
+  }
+  static inline void low() {
+    outReg() &= ~MASK;
+  }
+#else
+  static inline uint8_t read() {
+    return hostFastRead(PIN);
+  }
+  static inline void high() {
+    hostFastWrite(PIN, HIGH);
+  }
+  static inline void low() {
+    hostFastWrite(PIN, LOW);
+  }
+#endif
+
+  static inline void write(uint8_t val) {
+    if(val) {
+      high();
+    }
+    else {
+      low();
+    }
+  }
+};
+
+// A whole port in one read, so pins on the same port are sampled at the same instant.
+// read(mask) returns the input register with only the bits in mask (FastPin<pin>::MASK).
+template<uint8_t PORT>
+struct FastPort {
+  static const uint8_t FIRST_PIN = (PORT == fastIoPortD) ? 0 : ((PORT == fastIoPortB) ? 8 : 14);
+
+#if defined(SLOW_IO)
+  static inline uint8_t read(uint8_t mask) {
+    uint8_t value = 0;
+    for(uint8_t bit = 0; bit < 8; bit++) {
+      if((mask & (1 << bit)) && digitalRead(FIRST_PIN + bit)) {
+        value |= 1 << bit;
+      }
+    }
+    return value;
+  }
+#elif defined(__AVR__)
+  static inline uint8_t read(uint8_t mask) {
+    return ((PORT == fastIoPortD) ? PIND : ((PORT == fastIoPortB) ? PINB : PINC)) & mask;
+  }
+#else
+  static inline uint8_t read(uint8_t mask) {
+    return hostFastReadPort(FIRST_PIN, mask);
+  }
+#endif
+};
+
+#endif // FASTIO_H
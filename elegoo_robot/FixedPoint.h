@@ -0,0 +1,84 @@
+// Fixed-point helpers
+// The ATmega328 has no FPU, so every float operation is a few hundred cycles of soft-float
+// library code.  Hot paths use integer scale factors instead: computed at compile time (or
+// once at init) and applied with a multiply and a shift.
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include "Hal.h"
+
+// Convert a constant to Q16 (rounded).  Only use this on constant expressions so the compiler
+// folds the float math away.
+#define TO_Q16(x)  ((unsigned long)((x) * 65536.0 + 0.5))
+
+////////////////////////////////////////////////////////////////////
+// Returns (value * factor) >> shift, truncated toward zero like the float-to-int cast it
+// replaces.  |value| * factor must fit in 32 bits.
+inline long mulShift(long value, unsigned long factor, uint8_t shift) {
+  if(value < 0) {
+    return -(long)(((unsigned long)-value * factor) >> shift);
+  }
+  return (long)(((unsigned long)value * factor) >> shift);
+}
+
+////////////////////////////////////////////////////////////////////
+// Integer square root (rounded down), one result bit per iteration
+inline unsigned int isqrt(unsigned long value) {
+  unsigned long root = 0;
+  unsigned long bit = 1UL << 30;
+  while(bit > value) {
+    bit >>= 2;
+  }
+  while(bit) {
+    if(value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (unsigned int)root;
+}
+
+// Angles for the trig functions are in 1/65536ths of a turn so they wrap for free in a
+// uint16_t.  Results are in Q14 (16384 = 1.0).
+#define ANGLE_FULL_TURN    65536L
+#define DEG_TO_ANGLE(deg)  ((long)(deg) * ANGLE_FULL_TURN / 360)
+#define TRIG_ONE           16384
+
+// First quarter of a sine wave (65 points, 0..90 degrees), Q14
+const int16_t g_sinTable[65] PROGMEM = {
+      0,   402,   804,  1205,  1606,  2006,  2404,  2801,  3196,  3590,  3981,  4370,  4756,
+   5139,  5520,  5897,  6270,  6639,  7005,  7366,  7723,  8076,  8423,  8765,  9102,  9434,
+   9760, 10080, 10394, 10702, 11003, 11297, 11585, 11866, 12140, 12406, 12665, 12916, 13160,
+  13395, 13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978, 15137, 15286, 15426, 15557,
+  15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379, 16384
+};
+
+////////////////////////////////////////////////////////////////////
+// Sine of an angle (1/65536 turn), Q14.  Linear interpolation between table points.
+inline int isin(uint16_t angle) {
+  uint8_t quadrant = angle >> 14;
+  uint16_t pos = angle & 0x3FFF;
+  if(quadrant & 1) {
+    pos = 0x4000 - pos;   // Second half of each half-wave runs backwards through the table
+  }
+  uint8_t idx = pos >> 8;
+  uint8_t frac = pos & 0xFF;
+  int value = (int16_t)pgm_read_word(&g_sinTable[idx]);
+  if(frac) {
+    int next = (int16_t)pgm_read_word(&g_sinTable[idx + 1]);
+    value += ((long)(next - value) * frac) >> 8;
+  }
+  return (quadrant & 2) ? -value : value;
+}
+
+////////////////////////////////////////////////////////////////////
+// Cosine of an angle (1/65536 turn), Q14
+inline int icos(uint16_t angle) {
+  return isin(angle + 0x4000);
+}
+
+#endif // FIXEDPOINT_H
@@ -1,17 +1,49 @@
 // Subsystem for the cup gripper (circular jaws that rotate open and closed)
+// The servo has no feedback, so where the jaws are is worked out from when they were told to
+// move and how fast the servo turns.  isSettled() says when they've finished travelling, so
+// sequences can move on then instead of after a fixed wait.
 #ifndef GRIPPER_H
 #define GRIPPER_H
 
+#include "Hal.h"
+#include "PwmServo.h"
 #include "RobotMap.h"
-#include <Servo.h>
 
 // Gripper positions
 #define OPENED_POS  0
 #define CLOSED_POS  60
 
+// Motion model
+#define GRIPPER_SERVO_DEG_PER_SEC   300   // How fast the servo turns with the jaws on it
+#define GRIPPER_SETTLE_MARGIN_MS    50    // Default extra time for isSettled()
+
 class Gripper {
 private:
-  Servo servo;
+  PwmServo servo;
+  bool m_isOpen;
+  int m_startAngle;           // Where the jaws were when the move started
+  int m_targetAngle;
+  unsigned long m_startMs;
+  unsigned int m_degPerSec;   // Speed of the move (no faster than the servo)
+  int m_writtenAngle;         // Last angle sent to the servo
+
+  ////////////////////////////////////////////////////////////////////
+  // How long the current move takes (ms)
+  unsigned long getMoveMs() {
+    return (unsigned long)abs(m_targetAngle - m_startAngle) * 1000 / m_degPerSec;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Where the jaws are (or the slewed command is) at this moment
+  int calcAngle() {
+    unsigned long elapsedMs = millis() - m_startMs;
+    if(elapsedMs >= getMoveMs()) {
+      return m_targetAngle;
+    }
+    int travel = elapsedMs * m_degPerSec / 1000;
+    return (m_targetAngle > m_startAngle) ? m_startAngle + (int)travel : m_startAngle - (int)travel;
+  }
+
 public:
   ////////////////////////////////////////////////////////////////////
   // Constructor
@@ -21,19 +53,74 @@ public:
   // Initializer (constructor wasn't a good place to do this)
   void init() {
     servo.attach(GRIPPER_SERVO_PIN);
+
+    // Don't know where the jaws are at power-up, so allow for a full swing
+    m_startAngle = CLOSED_POS;
+    m_targetAngle = CLOSED_POS;
+    m_startMs = millis();
+    m_degPerSec = GRIPPER_SERVO_DEG_PER_SEC;
+    m_writtenAngle = CLOSED_POS;
     open();
   }
 
   ////////////////////////////////////////////////////////////////////
   // Open the gripper
   void open() {
-    servo.write(OPENED_POS);
+    moveTo(OPENED_POS);
   }
 
   ////////////////////////////////////////////////////////////////////
   // Close the gripper
   void close() {
-    servo.write(CLOSED_POS);
+    moveTo(CLOSED_POS);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Move the jaws to an angle.  degPerSec slows the move down (update() steps the servo
+  // there); 0 lets the servo go at its own speed.
+  void moveTo(int angle, unsigned int degPerSec = 0) {
+    m_startAngle = getAngle();
+    m_targetAngle = angle;
+    m_startMs = millis();
+    m_degPerSec = (degPerSec == 0 || degPerSec > GRIPPER_SERVO_DEG_PER_SEC) ?
+                  GRIPPER_SERVO_DEG_PER_SEC : degPerSec;
+    m_isOpen = (angle == OPENED_POS);
+    if(m_degPerSec == GRIPPER_SERVO_DEG_PER_SEC) {
+      m_writtenAngle = angle;
+      servo.write(angle);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Step a slowed-down moveTo().  Call every loop.
+  void update() {
+    if(m_writtenAngle == m_targetAngle) {
+      return;
+    }
+    int angle = calcAngle();
+    if(angle != m_writtenAngle) {
+      m_writtenAngle = angle;
+      servo.write(angle);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Estimated jaw angle
+  int getAngle() {
+    return calcAngle();
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns true once the jaws should have finished moving, plus marginMs for the servo to
+  // settle (and anything in the jaws to stop swinging)
+  bool isSettled(unsigned int marginMs = GRIPPER_SETTLE_MARGIN_MS) {
+    return (unsigned long)(millis() - m_startMs) >= getMoveMs() + marginMs;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns true if the gripper was last told to open (fully)
+  bool isOpen() {
+    return m_isOpen;
   }
 };
 
@@ -0,0 +1,20 @@
+// Hardware abstraction layer
+// All robot code includes this instead of <Arduino.h> directly.  On the robot (AVR) it pulls in
+// the Arduino core and the PinChangeInt library (the servos don't use the Servo library, see
+// PwmServo.h).  Anywhere else it pulls in the host backend (../host) so the sketch can be built
+// and run as a native Linux executable.
+#ifndef HAL_H
+#define HAL_H
+
+#ifdef __AVR__
+  #include <Arduino.h>
+
+  // Pin change interrupts (from https://github.com/GreyGnome/PinChangeInt).  Nothing on port B
+  // (pins 8-13) uses them.
+  #define NO_PORTB_PINCHANGES
+  #include "PinChangeInt.h"
+#else
+  #include "HalHost.h"
+#endif
+
+#endif // HAL_H
@@ -0,0 +1,123 @@
+// Analog line sensors
+// The ADC converts the three line sensor channels (A0-A2) one after the other in the
+// background.  The conversion-complete interrupt stores each result, switches the mux to the
+// next channel and starts the next conversion, so a full set is ready every ~0.3ms without the
+// loop ever waiting on analogRead().  Sets go into a double buffer: the ISR fills one half while
+// the other holds the last complete set, so a read always gets three values from one sweep.
+//
+// The ADC is taken over for good, so analogRead() can't be used anywhere else.  (Chaining
+// single conversions from the ISR rather than using free-running mode means each result is
+// known to be from the channel just selected.  In free-running mode a mux change only applies
+// from the conversion after next.)
+//
+// On the host the values come straight from analogRead() (see hostSetAnalog()).
+#ifndef LINESENSORS_H
+#define LINESENSORS_H
+
+#include "Hal.h"
+#include "RobotMap.h"
+
+#define LINE_CHANNELS       3
+#define LINE_FIRST_CHANNEL  (LINE_LEFT_PIN - A0)   // ADC mux channel of the left sensor
+
+// Darkness (1023 - reading, the sensors read low over black) below this is the white floor
+#define LINE_DARK_FLOOR     200
+#define LINE_DARK_MIN       100   // Total darkness (less the floor) below this is no line
+#define LINE_DARK_ON        500   // A sensor this dark (less the floor) is right over the line
+
+// Line position, see getPosition()
+#define LINE_POS_ONE        256   // Line under the right sensor (Q8 sensor spacings)
+
+// Double buffer shared with the ISR (the interrupts don't work with class functions)
+volatile uint16_t g_lineAdc[2][LINE_CHANNELS];
+volatile uint8_t g_lineAdcDone = 0;     // Half holding the last complete set
+volatile uint8_t g_lineAdcSweeps = 0;   // Complete sets so far (wraps)
+
+#ifdef __AVR__
+static_assert(LINE_MIDDLE_PIN == LINE_LEFT_PIN + 1 && LINE_RIGHT_PIN == LINE_LEFT_PIN + 2,
+              "The line sensors have to be on consecutive ADC channels");
+
+ISR(ADC_vect) {
+  static uint8_t s_channel = 0;
+  static uint8_t s_half = 1;
+  g_lineAdc[s_half][s_channel] = ADC;
+  if(++s_channel >= LINE_CHANNELS) {
+    s_channel = 0;
+    g_lineAdcDone = s_half;
+    s_half ^= 1;
+    g_lineAdcSweeps++;
+  }
+  ADMUX = _BV(REFS0) | (LINE_FIRST_CHANNEL + s_channel);
+  ADCSRA |= _BV(ADSC);
+}
+#endif
+
+
+class LineSensors {
+private:
+  uint8_t m_lastSweep;
+
+public:
+  LineSensors() {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Initializer (constructor wasn't a good place to do this)
+  void init() {
+    m_lastSweep = 0;
+#ifdef __AVR__
+    // AVcc reference, /128 prescaler (125kHz ADC clock, ~104us a conversion), interrupt on
+    // each result.  Starting the first conversion gets the chain going.
+    ADMUX = _BV(REFS0) | LINE_FIRST_CHANNEL;
+    ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0) | _BV(ADSC);
+#endif
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Copy the last complete set of readings (left, middle, right; 0..1023).  Returns true if it's
+  // a new set since the last call.
+  bool read(uint16_t *pValues) {
+#ifdef __AVR__
+    noInterrupts();
+    uint8_t half = g_lineAdcDone;
+    for(uint8_t i = 0; i < LINE_CHANNELS; i++) {
+      pValues[i] = g_lineAdc[half][i];
+    }
+    uint8_t sweep = g_lineAdcSweeps;
+    interrupts();
+#else
+    pValues[0] = analogRead(LINE_LEFT_PIN);
+    pValues[1] = analogRead(LINE_MIDDLE_PIN);
+    pValues[2] = analogRead(LINE_RIGHT_PIN);
+    uint8_t sweep = ++g_lineAdcSweeps;
+#endif
+    bool isNew = (sweep != m_lastSweep);
+    m_lastSweep = sweep;
+    return isNew;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Work out where the line is from a set of readings: the darkness-weighted average of the
+  // sensor positions, -LINE_POS_ONE (under the left sensor) to LINE_POS_ONE (under the right).
+  // Returns false if no sensor sees the line.  *pCrossing is set if all three are over it.
+  static bool getPosition(const uint16_t *pValues, int *pPosition, bool *pCrossing) {
+    int dark[LINE_CHANNELS];
+    int total = 0;
+    bool crossing = true;
+    for(uint8_t i = 0; i < LINE_CHANNELS; i++) {
+      int d = 1023 - (int)pValues[i] - LINE_DARK_FLOOR;
+      dark[i] = (d > 0) ? d : 0;
+      total += dark[i];
+      if(dark[i] < LINE_DARK_ON) {
+        crossing = false;
+      }
+    }
+    *pCrossing = crossing;
+    if(total < LINE_DARK_MIN) {
+      return false;
+    }
+    *pPosition = (int)(((long)(dark[2] - dark[0]) * LINE_POS_ONE) / total);
+    return true;
+  }
+};
+
+#endif
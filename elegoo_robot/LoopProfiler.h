@@ -0,0 +1,160 @@
+// Loop profiler
+// Times each stage of loop() with micros() and keeps min/max/mean and a log2 histogram per
+// stage in fixed RAM.  Enable with LOOP_PROFILER in RobotMap.h, then press PROFILE_DUMP_BTN to
+// print the results over Serial (this also resets them).
+#ifndef LOOPPROFILER_H
+#define LOOPPROFILER_H
+
+#include "Hal.h"
+#include "RobotMap.h"
+
+#define PROFILE_DUMP_BTN      13  // D-Down
+#define PROFILE_NUM_BUCKETS   14  // Bucket 0 is < 4us, bucket n is 2^(n+1)..2^(n+2)-1us, last is >= 16ms
+
+// Stages of loop() that get timed
+enum ProfileStage {
+  profLoop = 0,     // Full loop period (start to start)
+  profDsUpdate,
+  profTeleop,
+  profAutonomous,
+  profCmdSeq,
+  profDrive,
+  profMechanisms,   // Elevator and gripper
+  profLog,
+  NUM_PROFILE_STAGES
+};
+
+#ifdef LOOP_PROFILER
+  // Time a statement and record it against a stage
+  #define PROFILE(stage, statement)  do { \
+      unsigned long _profStartUs = micros(); \
+      statement; \
+      g_loopProfiler.record((stage), micros() - _profStartUs); \
+    } while(0)
+#else
+  #define PROFILE(stage, statement)  statement
+#endif
+
+class LoopProfiler {
+private:
+  struct StageStats {
+    uint32_t count;
+    uint32_t totalUs;
+    uint16_t minUs;   // Saturates at 65535
+    uint16_t maxUs;   // Saturates at 65535
+    uint16_t histogram[PROFILE_NUM_BUCKETS];  // Each bucket saturates at 65535
+  };
+  StageStats m_stages[NUM_PROFILE_STAGES];
+  unsigned long m_loopStartUs;
+  bool m_dumpRequested;
+
+  // Index of the histogram bucket for a duration
+  static uint8_t bucket(unsigned long us) {
+    uint8_t b = 0;
+    us >>= 2;
+    while(us && b < PROFILE_NUM_BUCKETS - 1) {
+      us >>= 1;
+      b++;
+    }
+    return b;
+  }
+
+public:
+  ////////////////////////////////////////////////////////////////////
+  // Constructor
+  LoopProfiler() {
+    reset();
+    m_dumpRequested = false;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Clear all stats
+  void reset() {
+    for(uint8_t s = 0; s < NUM_PROFILE_STAGES; s++) {
+      m_stages[s].count = 0;
+      m_stages[s].minUs = 0xffff;
+      m_stages[s].maxUs = 0;
+      m_stages[s].totalUs = 0;
+      for(uint8_t b = 0; b < PROFILE_NUM_BUCKETS; b++) {
+        m_stages[s].histogram[b] = 0;
+      }
+    }
+    m_loopStartUs = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Record one sample for a stage
+  void record(uint8_t stage, unsigned long us) {
+    StageStats &s = m_stages[stage];
+    uint16_t us16 = (us > 0xffff) ? 0xffff : us;
+    s.count++;
+    s.totalUs += us;
+    if(us16 < s.minUs) {
+      s.minUs = us16;
+    }
+    if(us16 > s.maxUs) {
+      s.maxUs = us16;
+    }
+    uint16_t &h = s.histogram[bucket(us)];
+    if(h != 0xffff) {
+      h++;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Call at the start of loop() to record the loop period
+  void loopStart() {
+    unsigned long now = micros();
+    if(m_loopStartUs != 0) {
+      record(profLoop, now - m_loopStartUs);
+    }
+    m_loopStartUs = now;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Ask for a dump at the end of the current loop (outside the timed stages)
+  void requestDump() {
+    m_dumpRequested = true;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Dump the stats if requested.  Call at the end of loop().
+  void service() {
+    if(m_dumpRequested) {
+      m_dumpRequested = false;
+      dump();
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Print the stats and reset them.  Blocks while Serial drains.
+  // One line per stage: name count min max mean | histogram buckets
+  void dump() {
+    // In flash, like the other printed text
+    static const char names[NUM_PROFILE_STAGES][8] PROGMEM = {
+      "loop", "ds", "teleop", "auto", "cmdSeq", "drive", "mech", "log"
+    };
+    Serial.println(F("Profile (us): stage n min max mean | <4 <8 <16 .. >=16384"));
+    for(uint8_t i = 0; i < NUM_PROFILE_STAGES; i++) {
+      StageStats &s = m_stages[i];
+      Serial.print((const __FlashStringHelper *)names[i]);
+      Serial.print(' ');
+      Serial.print(s.count);
+      Serial.print(' ');
+      Serial.print(s.count ? s.minUs : 0);
+      Serial.print(' ');
+      Serial.print(s.maxUs);
+      Serial.print(' ');
+      Serial.print(s.count ? s.totalUs / s.count : 0);
+      Serial.print(F(" |"));
+      for(uint8_t b = 0; b < PROFILE_NUM_BUCKETS; b++) {
+        Serial.print(' ');
+        Serial.print(s.histogram[b]);
+      }
+      Serial.println();
+    }
+    reset();
+  }
+};
+
+#endif // LOOPPROFILER_H
@@ -0,0 +1,64 @@
+// Trapezoidal motion profile for the auto drive moves
+// Ramps the speed up at a fixed acceleration, cruises at the max speed and decelerates so the
+// move arrives at its target at creep speed.  The deceleration is worked out from the distance
+// actually travelled (encoders) rather than from time, so it still lands on the target when
+// the wheels lag behind the profile.
+#ifndef MOTIONPROFILE_H
+#define MOTIONPROFILE_H
+
+#include "Hal.h"
+#include "FixedPoint.h"
+
+#define MOTION_MIN_SPEED     50      // mm/s, speed at the start and end of a move
+#define MOTION_MAX_RAMP_MS   30000   // Limit on the ramp time used (keeps the math in range)
+
+
+class MotionProfile {
+private:
+  int m_distanceMm;         // Length of the move (always positive)
+  int m_maxSpeed;           // mm/s
+  int m_accel;              // mm/s/s
+  unsigned long m_startMs;
+
+public:
+  MotionProfile() {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Start a new move (distance sign is ignored, the caller handles direction)
+  void start(int distanceMm, int maxSpeed, int accel) {
+    m_distanceMm = (distanceMm < 0) ? -distanceMm : distanceMm;
+    m_maxSpeed = (maxSpeed < MOTION_MIN_SPEED) ? MOTION_MIN_SPEED : maxSpeed;
+    m_accel = accel;
+    m_startMs = millis();
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns the speed (mm/s, always positive) to run at once travelledMm of the move is done
+  int getSpeed(int travelledMm) {
+    // Accelerating (or cruising)
+    unsigned long rampMs = millis() - m_startMs;
+    if(rampMs > MOTION_MAX_RAMP_MS) {
+      rampMs = MOTION_MAX_RAMP_MS;
+    }
+    long speed = MOTION_MIN_SPEED + (long)(rampMs * m_accel / 1000);
+    if(speed > m_maxSpeed) {
+      speed = m_maxSpeed;
+    }
+
+    // Decelerating: the fastest speed that can still stop in the distance left (v^2 = 2ad)
+    long remainingMm = (long)m_distanceMm - travelledMm;
+    if(remainingMm < 0) {
+      remainingMm = 0;
+    }
+    long stopSpeed = isqrt(2UL * m_accel * remainingMm);
+    if(stopSpeed < MOTION_MIN_SPEED) {
+      stopSpeed = MOTION_MIN_SPEED;
+    }
+    if(speed > stopSpeed) {
+      speed = stopSpeed;
+    }
+    return (int)speed;
+  }
+};
+
+#endif
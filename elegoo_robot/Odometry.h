@@ -0,0 +1,97 @@
+// Differential-drive odometry
+// Keeps a pose estimate (x, y, heading) from the wheel encoder ticks.  Field coordinates: x is
+// forward and y is to the right of where the robot was at reset(), heading is clockwise (same
+// direction as Drivetrain::autoRotate()).  All integer math.
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include "Hal.h"
+#include "FixedPoint.h"
+
+
+class Odometry {
+private:
+  long m_xQ8;                   // mm, Q8
+  long m_yQ8;                   // mm, Q8
+  unsigned long m_headingQ8;    // 1/65536 turn, Q8 (wraps every 256 turns)
+  unsigned long m_mmPerTickQ12;
+  unsigned long m_headingPerTickQ8;
+
+public:
+  Odometry() {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Initializer (constructor wasn't a good place to do this)
+  // mmPerTickQ12: wheel travel per tick in Q12
+  // headingPerTickQ8: heading change (1/65536 turn, Q8) per tick of difference between the sides
+  void init(unsigned long mmPerTickQ12, unsigned long headingPerTickQ8) {
+    m_mmPerTickQ12 = mmPerTickQ12;
+    m_headingPerTickQ8 = headingPerTickQ8;
+    reset();
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Make the current position the origin
+  void reset() {
+    m_xQ8 = 0;
+    m_yQ8 = 0;
+    m_headingQ8 = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Add a batch of ticks from each side (signed, forward is positive)
+  void update(int leftTicks, int rightTicks) {
+    if(leftTicks == 0 && rightTicks == 0) {
+      return;
+    }
+
+    // Heading change from the difference between the sides
+    long turnQ8 = (long)(leftTicks - rightTicks) * (long)m_headingPerTickQ8;
+
+    // Distance of the centre (average of the sides), mm Q8.  Moved along the heading half way
+    // through the turn, which is close enough for the small batches this gets.
+    long distanceQ8 = mulShift((long)leftTicks + rightTicks, m_mmPerTickQ12, 12 - 8 + 1);
+    uint16_t midHeading = (m_headingQ8 + turnQ8 / 2) >> 8;
+    m_xQ8 += (distanceQ8 * icos(midHeading) + TRIG_ONE / 2) >> 14;
+    m_yQ8 += (distanceQ8 * isin(midHeading) + TRIG_ONE / 2) >> 14;
+    m_headingQ8 += turnQ8;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Position (mm)
+  long getXMm() {
+    return m_xQ8 >> 8;
+  }
+  long getYMm() {
+    return m_yQ8 >> 8;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Heading (1/65536 turn)
+  uint16_t getHeading() {
+    return m_headingQ8 >> 8;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Heading (degrees, 0..359)
+  int getHeadingDeg() {
+    return ((unsigned long)getHeading() * 360) >> 16;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Total heading (1/65536 turn, Q8) without wrapping at a full turn.  Take the difference of
+  // two readings (as a long) to get how far the robot turned in between.
+  unsigned long getTotalHeadingQ8() {
+    return m_headingQ8;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Field position of a point distanceMm straight ahead of the robot
+  void getPointAhead(int distanceMm, long *pXMm, long *pYMm) {
+    uint16_t heading = getHeading();
+    *pXMm = (m_xQ8 + (((long)distanceMm * icos(heading)) >> 6)) >> 8;
+    *pYMm = (m_yQ8 + (((long)distanceMm * isin(heading)) >> 6)) >> 8;
+  }
+};
+
+#endif
@@ -0,0 +1,100 @@
+// Servo driver on Timer1's PWM outputs
+// The gripper and elevator servos are on pins 9 and 10, which are Timer1's OC1A and OC1B.  The
+// Servo library drives them from a Timer1 compare interrupt every few ms, which delays the
+// encoder interrupts and takes time from the loop.  Here Timer1 runs in fast PWM mode with ICR1
+// as TOP for a 20ms (50Hz) period, and write() just sets the pulse width in OCR1A/OCR1B.  The
+// hardware makes the pulses: no interrupts, no jitter.
+// - Only pins 9 and 10.  Timer1 is taken over, so nothing else can use it (or analogWrite() on
+//   those pins).
+// - Same angles as the Servo library (0..180 = 544us..2400us pulses), so the elevator's
+//   continuous servo still stops at 90.
+// On the host the angle goes to the host HAL's Servo (see hostGetServo()).
+#ifndef PWMSERVO_H
+#define PWMSERVO_H
+
+#include "Hal.h"
+#include "RobotMap.h"
+
+#define PWM_SERVO_MIN_US        544     // Pulse for 0 degrees (same as the Servo library)
+#define PWM_SERVO_MAX_US        2400    // Pulse for 180 degrees
+#define PWM_SERVO_TICKS_PER_US  2       // 16MHz / 8 prescaler
+#define PWM_SERVO_PERIOD_US     20000   // 50Hz
+
+static_assert((GRIPPER_SERVO_PIN == 9 || GRIPPER_SERVO_PIN == 10) &&
+              (ELEVATOR_SERVO_PIN == 9 || ELEVATOR_SERVO_PIN == 10),
+              "PwmServo only works on Timer1's outputs (pins 9 and 10)");
+
+class PwmServo {
+private:
+  int8_t m_pin;
+  int m_angle;
+#ifndef __AVR__
+  Servo m_hostServo;
+#endif
+
+public:
+  ////////////////////////////////////////////////////////////////////
+  // Constructor
+  PwmServo() : m_pin(-1), m_angle(-1) {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Timer1 compare value for an angle (0..180, clamped)
+  static uint16_t angleToTicks(int angle) {
+    if(angle < 0) {
+      angle = 0;
+    }
+    else if(angle > 180) {
+      angle = 180;
+    }
+    long us = PWM_SERVO_MIN_US + (long)angle * (PWM_SERVO_MAX_US - PWM_SERVO_MIN_US) / 180;
+    return (uint16_t)(us * PWM_SERVO_TICKS_PER_US);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Start the pulses on pin 9 (OC1A) or 10 (OC1B).  Nothing goes out until the first write().
+  void attach(uint8_t pin) {
+    m_pin = pin;
+#ifdef __AVR__
+    // Mode 14 (fast PWM, TOP = ICR1), /8 prescaler.  Setting it up again for the second pin
+    // leaves the first one's output going.
+    TCCR1A = (TCCR1A & (_BV(COM1A1) | _BV(COM1B1))) | _BV(WGM11);
+    TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS11);
+    ICR1 = PWM_SERVO_PERIOD_US * PWM_SERVO_TICKS_PER_US - 1;
+    pinMode(pin, OUTPUT);
+#else
+    m_hostServo.attach(pin);
+#endif
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Set the angle (0..180).  Takes effect from the next period.
+  void write(int angle) {
+    m_angle = (angle < 0) ? 0 : ((angle > 180) ? 180 : angle);
+#ifdef __AVR__
+    uint16_t ticks = angleToTicks(angle);
+    // 16-bit timer registers are written through a shared temp byte, so keep any interrupt
+    // that writes the other servo (the elevator limit ISR) out of the middle of it
+    uint8_t oldSreg = SREG;
+    noInterrupts();
+    if(m_pin == 9) {
+      OCR1A = ticks;
+      TCCR1A |= _BV(COM1A1);
+    }
+    else if(m_pin == 10) {
+      OCR1B = ticks;
+      TCCR1A |= _BV(COM1B1);
+    }
+    SREG = oldSreg;
+#else
+    m_hostServo.write(angle);
+#endif
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Last angle written (-1 if none)
+  int read() {
+    return m_angle;
+  }
+};
+
+#endif // PWMSERVO_H
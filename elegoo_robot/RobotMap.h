@@ -26,5 +26,9 @@
 // Debug and alternate modes
 //#define DRIVE_ONLY  1
 //#define SCAN_AND_ALIGN  1
+//#define LOOP_PROFILER  1  // Time each stage of loop(), press D-Down to print (see LoopProfiler.h)
+//#define TELEMETRY  1      // Stream binary robot state over Serial (see Telemetry.h)
+//#define SLOW_IO  1        // digitalRead()/digitalWrite() instead of FastPin (see FastIO.h)
+//#define DIGITAL_LINE_FOLLOWER  1  // Bang-bang line follower instead of the analog PD one
 
 #endif // ROBOTMAP_H
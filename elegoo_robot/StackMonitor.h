@@ -0,0 +1,66 @@
+// Stack high-water mark
+// Before anything else runs at reset, stackPaint() fills the free SRAM between the end of the
+// globals (.data/.bss) and the top of the stack with STACK_PAINT.  The stack grows down into it,
+// so counting the painted bytes still left above the globals gives the least free SRAM there has
+// been since reset: the headroom new buffers can still have.  Nothing uses malloc(), so there is
+// no heap in between.
+// The host build has no painted stack and reports -1.
+#ifndef STACKMONITOR_H
+#define STACKMONITOR_H
+
+#include "Hal.h"
+
+#define STACK_PAINT   0xC5
+
+#ifdef __AVR__
+extern uint8_t _end;      // End of .bss (from the linker)
+extern uint8_t __stack;   // Top of SRAM
+
+// Runs from .init1, before the C runtime has set up r1 or the stack pointer, so it's assembly
+// only.  Paints _end .. __stack.
+void stackPaint(void) __attribute__((naked, used, section(".init1")));
+void stackPaint(void) {
+  __asm volatile(
+    "    ldi r30, lo8(_end)\n"
+    "    ldi r31, hi8(_end)\n"
+    "    ldi r24, %0\n"
+    "    ldi r25, hi8(__stack)\n"
+    "    rjmp 2f\n"
+    "1:  st Z+, r24\n"
+    "2:  cpi r30, lo8(__stack)\n"
+    "    cpc r31, r25\n"
+    "    brlo 1b\n"
+    "    breq 1b\n"
+    :: "i"(STACK_PAINT));
+}
+#endif
+
+////////////////////////////////////////////////////////////////////
+// Bytes of SRAM the stack has never reached since reset (-1 on the host)
+inline int getStackHeadroom() {
+#ifdef __AVR__
+  const uint8_t *p = &_end;
+  while(p <= &__stack && *p == STACK_PAINT) {
+    p++;
+  }
+  return p - &_end;
+#else
+  return -1;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+// Print the globals' size and the stack headroom.  Blocks while Serial drains, so only call it
+// on request.
+inline void printMemoryStatus() {
+#ifdef __AVR__
+  Serial.print(F("SRAM globals "));
+  Serial.print((int)(&_end - (uint8_t *)RAMSTART));
+  Serial.print(F(" stack headroom "));
+  Serial.println(getStackHeadroom());
+#else
+  Serial.println(F("SRAM globals n/a stack headroom n/a"));
+#endif
+}
+
+#endif // STACKMONITOR_H
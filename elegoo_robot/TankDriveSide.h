@@ -2,11 +2,21 @@
 #ifndef TANKDRIVESIDE_H
 #define TANKDRIVESIDE_H
 
+#include "Hal.h"
+#include "FastIO.h"
+
+// Set the L298 direction inputs (1 = forward, -1 = reverse, 0 = off).  A template so the pins
+// are constants and FastPin can turn each write into one instruction.
+template<uint8_t IN1_PIN, uint8_t IN2_PIN>
+void setL298Direction(int8_t dir) {
+  FastPin<IN1_PIN>::write(dir > 0);
+  FastPin<IN2_PIN>::write(dir < 0);
+}
+
 class TankDriveSide {
 private:
   int m_enPin;
-  int m_in1Pin;
-  int m_in2Pin;
+  void (*m_pSetDirection)(int8_t dir);
   int m_curPower;
 
 public:
@@ -15,23 +25,25 @@ public:
 
   ////////////////////////////////////////////////////////////////////
   // Initializer (constructor wasn't a good place to do this)
-  void init(int enPin, int in1Pin, int in2Pin) {
+  // The direction pins are template arguments, e.g. init<L298_IN1_PIN, L298_IN2_PIN>(L298_ENA_PIN)
+  template<uint8_t IN1_PIN, uint8_t IN2_PIN>
+  void init(int enPin) {
     m_enPin = enPin;
-    m_in1Pin = in1Pin;
-    m_in2Pin = in2Pin;
+    m_pSetDirection = setL298Direction<IN1_PIN, IN2_PIN>;
 
     pinMode(m_enPin, OUTPUT);
-    pinMode(m_in1Pin, OUTPUT);
-    pinMode(m_in2Pin, OUTPUT);
+    pinMode(IN1_PIN, OUTPUT);
+    pinMode(IN2_PIN, OUTPUT);
 
     // Make sure motors are stopped
     m_curPower = 0;
-    digitalWrite(m_in1Pin, LOW);
-    digitalWrite(m_in2Pin, LOW);
+    m_pSetDirection(0);
     analogWrite(m_enPin, m_curPower); 
   }
 
-  // Set the motors on this side to specified power (0..255)
+  ////////////////////////////////////////////////////////////////////
+  // Set the motors on this side to specified power (0..255).  This is the output stage for
+  // both open loop driving and VelocityController.
   void setPower(int power) {
     // Impose range limit
     if(power > 255) {
@@ -45,23 +57,26 @@ public:
     if(power != m_curPower) {
       // Set the motors to the desired power
       if(power > 0) {
-        digitalWrite(m_in1Pin, HIGH);
-        digitalWrite(m_in2Pin, LOW);
+        m_pSetDirection(1);
         analogWrite(m_enPin, power);
       }
       else if(power < 0) {
-        digitalWrite(m_in1Pin, LOW);
-        digitalWrite(m_in2Pin, HIGH);
+        m_pSetDirection(-1);
         analogWrite(m_enPin, -power);
       }
       else {
-        digitalWrite(m_in1Pin, LOW);
-        digitalWrite(m_in2Pin, LOW);
+        m_pSetDirection(0);
         analogWrite(m_enPin, 0);
       }
       m_curPower = power;
     }
   }
+
+  ////////////////////////////////////////////////////////////////////
+  // Get the power last set (-255..255)
+  int getPower() {
+    return m_curPower;
+  }
 };
 
 #endif
@@ -0,0 +1,123 @@
+// Binary telemetry
+// Sends a fixed-size snapshot of the robot state over Serial every TELEMETRY_PERIOD_MS.  Framed
+// the same way as the DriverStation packets (preamble, version, length, 16-bit byte sum) so the
+// host decoder (host/telemetry_decode) can pick the packets out of the text the sketch also
+// prints.  Enable with TELEMETRY in RobotMap.h.
+//
+// A packet is only sent if it fits in the Serial TX buffer, so telemetry never blocks the loop.
+// Skipped packets still use up a sequence number, which shows up as a gap in the decoded data.
+// At the default rate the stream is 36 bytes x 20/s = 720 bytes/s, ~6% of the 115200 baud link.
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "Hal.h"
+
+#define TELEMETRY_PREAMBLE    0x5A  // DriverStation uses 0xA5
+#define TELEMETRY_VERSION     1
+#define TELEMETRY_PERIOD_MS   50
+
+// TelemetryData::u8Flags bits
+#define TELEM_ELEVATOR_LOWER  0x01  // Elevator lower limit switch
+#define TELEM_ELEVATOR_UPPER  0x02  // Elevator upper limit switch
+#define TELEM_LINE_LEFT       0x04  // Line sensors (set = sees the line)
+#define TELEM_LINE_MIDDLE     0x08
+#define TELEM_LINE_RIGHT      0x10
+#define TELEM_GRIPPER_OPEN    0x20
+
+// The packet.  Little-endian and laid out so every field is naturally aligned (the same bytes
+// on the Uno and the host).
+struct TelemetryData {
+  uint8_t   u8Preamble;
+  uint8_t   u8Version;
+  uint8_t   u8Len;
+  uint8_t   u8Seq;            // Counts every packet due, sent or not
+  uint32_t  u32TimeMs;
+  uint16_t  u16Loops;         // loop() calls since the last packet
+  uint16_t  u16MaxLoopUs;     // Longest loop() since the last packet
+  int16_t   i16LeftTicks;     // Encoder counts (reset at the start of each auto move)
+  int16_t   i16RightTicks;
+  int16_t   i16XMm;           // Odometry
+  int16_t   i16YMm;
+  uint16_t  u16Heading;       // 1/65536 turn, clockwise
+  int16_t   i16LeftPower;     // -255..255
+  int16_t   i16RightPower;
+  int16_t   i16ElevatorPower; // -256..256
+  int16_t   i16UltrasonicMm;  // Last reading (-1 = no echo)
+  int8_t    i8CmdStep;        // Step of the running command (-1 = none)
+  uint8_t   u8Busy;           // Subsystems in use by commands (REQ_* bits)
+  uint8_t   u8Flags;          // TELEM_* bits
+  uint8_t   u8LinkErrors;     // DriverStation bad packets (low byte, wraps)
+  uint16_t  u16Sum;
+};
+
+
+class Telemetry {
+private:
+  unsigned long m_lastLoopUs;
+  unsigned long m_nextSendMs;
+  uint16_t m_loops;
+  uint16_t m_maxLoopUs;
+  uint8_t m_seq;
+
+public:
+  Telemetry() {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Initializer (constructor wasn't a good place to do this)
+  void init() {
+    m_lastLoopUs = micros();
+    m_nextSendMs = millis();
+    m_loops = 0;
+    m_maxLoopUs = 0;
+    m_seq = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Keep track of the loop timing.  Call once every loop.  Returns true when a packet is due:
+  // fill in the robot state and pass it to send().
+  bool update() {
+    unsigned long now = micros();
+    unsigned long loopUs = now - m_lastLoopUs;
+    m_lastLoopUs = now;
+    if(m_loops != 0xffff) {
+      m_loops++;
+    }
+    if(loopUs > m_maxLoopUs) {
+      m_maxLoopUs = (loopUs > 0xffff) ? 0xffff : loopUs;
+    }
+    return (long)(millis() - m_nextSendMs) >= 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Fill in the framing and loop timing and send the packet if there's room for it
+  void send(TelemetryData &data) {
+    m_nextSendMs += TELEMETRY_PERIOD_MS;
+    if((long)(millis() - m_nextSendMs) >= 0) {
+      // Fell behind, don't try to catch up
+      m_nextSendMs = millis() + TELEMETRY_PERIOD_MS;
+    }
+
+    data.u8Preamble = TELEMETRY_PREAMBLE;
+    data.u8Version = TELEMETRY_VERSION;
+    data.u8Len = sizeof(TelemetryData);
+    data.u8Seq = m_seq++;
+    data.u32TimeMs = millis();
+    data.u16Loops = m_loops;
+    data.u16MaxLoopUs = m_maxLoopUs;
+    m_loops = 0;
+    m_maxLoopUs = 0;
+
+    const uint8_t *pBytes = (const uint8_t *)&data;
+    uint16_t sum = 0;
+    for(uint8_t i = 0; i < sizeof(TelemetryData) - 2; i++) {
+      sum += pBytes[i];
+    }
+    data.u16Sum = sum;
+
+    if(Serial.availableForWrite() >= (int)sizeof(TelemetryData)) {
+      Serial.write(pBytes, sizeof(TelemetryData));
+    }
+  }
+};
+
+#endif
@@ -1,27 +1,201 @@
+// Timers
+// - Timer is a single deadline for code that polls it (each Command has its own, see
+//   CommandScheduler.h).
+// - TimerService (g_timers) calls a function when a deadline passes, one-shot or periodic, for
+//   up to MAX_TIMERS deadlines at once.  service() runs the callbacks from loop().
+// Everything compares elapsed time (now - start, unsigned), never now against a deadline, so
+// millis() wrapping after 49.7 days (micros() after 71.6 minutes) doesn't matter.  Times have to
+// be less than half the wrap: 24 days in ms, 35 minutes in us.  (The times are uint32_t rather
+// than unsigned long so the wrap is the same in the 64-bit host build.)
 #ifndef MYTIMER_H
 #define MYTIMER_H
 
+#include "Hal.h"
+
 class Timer {
 private:
-  unsigned long targetTime;
+  uint32_t m_startTime;
+  uint32_t m_length;
+  bool m_isUs;
 public:
   ////////////////////////////////////////////////////////////////////
   // Constructor
   Timer() {
-    targetTime = 0;
+    m_startTime = 0;
+    m_length = 0;
+    m_isUs = false;
   }
 
   ////////////////////////////////////////////////////////////////////
-  // Constructor
-  void set(unsigned long timeMs) {
-    targetTime = millis() + timeMs;
+  // Expire timeMs from now
+  void set(uint32_t timeMs) {
+    m_startTime = millis();
+    m_length = timeMs;
+    m_isUs = false;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Expire timeUs from now
+  void setUs(uint32_t timeUs) {
+    m_startTime = micros();
+    m_length = timeUs;
+    m_isUs = true;
   }
 
   ////////////////////////////////////////////////////////////////////
-  // Returns true if the current time is >= to the time the timer was set for
+  // Returns true once the time the timer was set for has passed
   bool isExpired() {
-    return (millis() >= targetTime) ? true : false;
+    uint32_t now = m_isUs ? micros() : millis();
+    return (now - m_startTime) >= m_length;
+  }
+};
+
+
+#define MAX_TIMERS  4
+#define NO_TIMER    0xFF
+
+typedef void (*TimerCallback)(void);
+
+class TimerService {
+private:
+  struct Slot {
+    TimerCallback callback;     // NULL when the slot is free
+    uint32_t deadline;
+    uint32_t period;            // 0 for one-shot
+    bool isUs;
+  };
+  Slot m_slots[MAX_TIMERS];
+  // Earliest deadline in each unit, so service() is two subtractions when nothing is due
+  bool m_hasMs;
+  bool m_hasUs;
+  uint32_t m_nextMs;
+  uint32_t m_nextUs;
+
+  ////////////////////////////////////////////////////////////////////
+  // True if t has passed (as seen from now)
+  static bool isDue(uint32_t now, uint32_t t) {
+    return (int32_t)(now - t) >= 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Work out the earliest deadlines again after a change
+  void findNext() {
+    uint32_t nowMs = millis();
+    uint32_t nowUs = micros();
+    m_hasMs = false;
+    m_hasUs = false;
+    for(uint8_t i = 0; i < MAX_TIMERS; i++) {
+      Slot &slot = m_slots[i];
+      if(!slot.callback) {
+        continue;
+      }
+      if(slot.isUs) {
+        if(!m_hasUs || (int32_t)(slot.deadline - nowUs) < (int32_t)(m_nextUs - nowUs)) {
+          m_nextUs = slot.deadline;
+        }
+        m_hasUs = true;
+      }
+      else {
+        if(!m_hasMs || (int32_t)(slot.deadline - nowMs) < (int32_t)(m_nextMs - nowMs)) {
+          m_nextMs = slot.deadline;
+        }
+        m_hasMs = true;
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns the slot or NO_TIMER if they're all in use
+  uint8_t start(uint32_t now, uint32_t time, bool isUs, TimerCallback callback,
+                bool periodic) {
+    uint8_t id = 0;
+    while(id < MAX_TIMERS && m_slots[id].callback) {
+      id++;
+    }
+    if(id >= MAX_TIMERS) {
+      return NO_TIMER;
+    }
+    Slot &slot = m_slots[id];
+    slot.callback = callback;
+    slot.deadline = now + time;
+    slot.period = periodic ? time : 0;
+    slot.isUs = isUs;
+    findNext();
+    return id;
+  }
+
+public:
+  ////////////////////////////////////////////////////////////////////
+  // Constructor
+  TimerService() {
+    for(uint8_t i = 0; i < MAX_TIMERS; i++) {
+      m_slots[i].callback = NULL;
+    }
+    m_hasMs = false;
+    m_hasUs = false;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Call callback timeMs from now (and every timeMs after that if periodic).  Returns the timer
+  // id for cancel() or NO_TIMER if they're all in use.
+  uint8_t startMs(uint32_t timeMs, TimerCallback callback, bool periodic = false) {
+    return start(millis(), timeMs, false, callback, periodic);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Same as startMs() in microseconds.  Still only as often as service() runs (once a loop).
+  uint8_t startUs(uint32_t timeUs, TimerCallback callback, bool periodic = false) {
+    return start(micros(), timeUs, true, callback, periodic);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Stop a timer (if it's still going)
+  void cancel(uint8_t id) {
+    if(id < MAX_TIMERS) {
+      m_slots[id].callback = NULL;
+      findNext();
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns true if the timer hasn't fired (or is periodic) and wasn't cancelled
+  bool isActive(uint8_t id) {
+    return id < MAX_TIMERS && m_slots[id].callback;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Call the callbacks for the deadlines that have passed.  Call every loop.
+  void service() {
+    uint32_t nowMs = millis();
+    uint32_t nowUs = micros();
+    if(!(m_hasMs && isDue(nowMs, m_nextMs)) && !(m_hasUs && isDue(nowUs, m_nextUs))) {
+      return;
+    }
+
+    for(uint8_t i = 0; i < MAX_TIMERS; i++) {
+      Slot &slot = m_slots[i];
+      uint32_t now = slot.isUs ? nowUs : nowMs;
+      if(!slot.callback || !isDue(now, slot.deadline)) {
+        continue;
+      }
+      TimerCallback callback = slot.callback;
+      if(slot.period) {
+        // Keep to the period, unless it's fallen a whole period behind
+        slot.deadline += slot.period;
+        if(isDue(now, slot.deadline)) {
+          slot.deadline = now + slot.period;
+        }
+      }
+      else {
+        slot.callback = NULL;
+      }
+      // The callback can start or cancel timers (this slot included)
+      callback();
+    }
+    findNext();
   }
 };
 
+TimerService g_timers;
+
 #endif
@@ -3,33 +3,98 @@
 #ifndef ULTRASONICSENSOR_H
 #define ULTRASONICSENSOR_H
 
+#include "Hal.h"
 #include "RobotMap.h"
+#include "FastIO.h"
 
 // Useful constants for ultrasonic calculations
 #define MAX_DISTANCE 4500 // mm, some sensors are max 4000
-#define SPEED_OF_SOUND_MM_PER_US 0.343  // Dry air, 20degC
-#define ULTRASONIC_TIMEOUT ((MAX_DISTANCE + 500) * 2 / SPEED_OF_SOUND_MM_PER_US)  // Add 500mm worth of spare time in the timeout
+#define SPEED_OF_SOUND_MM_PER_MS 343  // Dry air, 20degC (0.343mm/us)
+#define ULTRASONIC_TIMEOUT ((MAX_DISTANCE + 500) * 2000UL / SPEED_OF_SOUND_MM_PER_MS)  // Add 500mm worth of spare time in the timeout
+
+// Asynchronous (interrupt-captured) ranging
+#define ULTRASONIC_RANGE_MARGIN_MM  50      // Keep listening this much past the requested range
+#define ULTRASONIC_RISE_TIMEOUT_US  2000    // ECHO normally goes high ~0.5ms after the trigger
+#define ULTRASONIC_MIN_PERIOD_US    10000   // Let stray echoes from the last ping die out
+#define ULTRASONIC_BEYOND_RANGE     32767   // Reading when nothing was seen within the range
+
+// Need globals for the echo capture because the interrupts don't work with class functions
+enum EchoStates {
+  echoIdle = 0,   // No ping in flight
+  echoWaitRise,   // Triggered, waiting for ECHO to go high
+  echoHigh,       // ECHO is high (sound is in flight)
+  echoDone        // ECHO went low, g_echoWidthUs is valid
+};
+volatile uint8_t g_echoState = echoIdle;
+volatile unsigned long g_echoRiseUs = 0;
+volatile unsigned long g_echoWidthUs = 0;
+void ultrasonicEchoIsr(void) {
+  unsigned long now = micros();
+  if(FastPin<ULTRASONIC_ECHO>::read()) {
+    if(g_echoState == echoWaitRise) {
+      g_echoRiseUs = now;
+      g_echoState = echoHigh;
+    }
+  }
+  else if(g_echoState == echoHigh) {
+    g_echoWidthUs = now - g_echoRiseUs;
+    g_echoState = echoDone;
+  }
+}
+
 
 class UltrasonicSensor {
+private:
+  unsigned long m_triggerUs;
+  unsigned long m_maxEchoUs;
+  int m_readingMm;
+  bool m_hasReading;
+
+  ////////////////////////////////////////////////////////////////////
+  // Send the 10us trigger pulse
+  void sendTrigger() {
+    FastPin<ULTRASONIC_TRIG>::low();
+    delayMicroseconds(2);
+    FastPin<ULTRASONIC_TRIG>::high();
+    delayMicroseconds(10);
+    FastPin<ULTRASONIC_TRIG>::low();
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Store the result of an asynchronous ping
+  void setReading(int distanceMm) {
+    m_readingMm = distanceMm;
+    m_hasReading = true;
+  }
+
 public:
-  UltrasonicSensor() {
+  UltrasonicSensor() {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Initializer (constructor wasn't a good place to do this)
+  void init() {
+    m_triggerUs = micros() - ULTRASONIC_MIN_PERIOD_US;
+    m_maxEchoUs = 0;
+    m_readingMm = -1;
+    m_hasReading = false;
+
     pinMode(ULTRASONIC_TRIG, OUTPUT);
     pinMode(ULTRASONIC_ECHO, INPUT);
+    attachPinChangeInterrupt(ULTRASONIC_ECHO, ultrasonicEchoIsr, CHANGE);
   }
 
+  ////////////////////////////////////////////////////////////////////
+  // Blocking measurement (stalls the loop for up to ULTRASONIC_TIMEOUT, ~29ms).  Don't mix
+  // with the asynchronous calls below.
   int getDistanceMm() {
     // Using the ultrasonic sensor
     // - TRIG must be low for at least 2us, then high for 10us, then put back low.
     // - If an object is detected, ECHO will output a pulse that will stay high for
     //   the same amount of time that it took for the emitted pulse to go out and return.
-  
+
     // Start by triggering the transmission of the 8-pulse 40kHz signal
-    digitalWrite(ULTRASONIC_TRIG, LOW);
-    delayMicroseconds(2);
-    digitalWrite(ULTRASONIC_TRIG, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(ULTRASONIC_TRIG, LOW);
-  
+    sendTrigger();
+
     // Check to see if an echo was heard
     // Echo time and timeout are in microseconds (us)
     unsigned long echoTime = pulseIn(ULTRASONIC_ECHO, HIGH, ULTRASONIC_TIMEOUT);
@@ -37,12 +102,95 @@ public:
       // No pulse started before the timeout.  Return an error code.
       return -1;
     }
-  
+
     // Calculate the distance
     // - Take the time that it took to hear the echo and divide by 2 since we only want
     //   the time it took to get to the object, not the time to get there and come back.
-    // - Multiply the time it took by the speed of sound (340m/s = 340000mm/s = 0.34mm/us).
-    return (int)(echoTime * SPEED_OF_SOUND_MM_PER_US / 2);
+    // - Multiply the time it took by the speed of sound (343m/s = 343mm/ms = 0.343mm/us).
+    return (int)(echoTime * SPEED_OF_SOUND_MM_PER_MS / 2000);
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Start an asynchronous measurement and return immediately.  The echo is timestamped by the
+  // pin change interrupt and anything farther than maxDistanceMm is abandoned early (reads
+  // ULTRASONIC_BEYOND_RANGE).  Returns false (and does nothing) if a ping is still in flight,
+  // the sensor is still busy or the last ping was too recent, so it's safe to call every loop.
+  bool trigger(int maxDistanceMm = MAX_DISTANCE) {
+    if(g_echoState != echoIdle || FastPin<ULTRASONIC_ECHO>::read() ||
+       (micros() - m_triggerUs) < ULTRASONIC_MIN_PERIOD_US) {
+      return false;
+    }
+
+    // Round-trip time to the edge of the range
+    m_maxEchoUs = (unsigned long)(maxDistanceMm + ULTRASONIC_RANGE_MARGIN_MM) * 2000 / SPEED_OF_SOUND_MM_PER_MS;
+    g_echoState = echoWaitRise;
+    sendTrigger();
+    m_triggerUs = micros();
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Service the asynchronous measurement (call every loop).  Returns true if a reading is
+  // waiting to be collected with getReadingMm().
+  bool poll() {
+    switch(g_echoState) {
+    case echoIdle:
+      break;
+
+    case echoWaitRise:
+      // The sensor never answered
+      if((micros() - m_triggerUs) > ULTRASONIC_RISE_TIMEOUT_US) {
+        noInterrupts();
+        if(g_echoState == echoWaitRise) {
+          g_echoState = echoIdle;
+          setReading(-1);
+        }
+        interrupts();
+      }
+      break;
+
+    case echoHigh:
+      // Give up once the sound has gone past the range we care about.  The sensor keeps ECHO
+      // high until it hears something (or times out) so trigger() waits for it to drop.
+      noInterrupts();
+      if(g_echoState == echoHigh && (micros() - g_echoRiseUs) > m_maxEchoUs) {
+        g_echoState = echoIdle;
+        setReading(ULTRASONIC_BEYOND_RANGE);
+      }
+      interrupts();
+      break;
+
+    case echoDone:
+      // Same calculation as getDistanceMm()
+      if(g_echoWidthUs > m_maxEchoUs) {
+        setReading(ULTRASONIC_BEYOND_RANGE);
+      }
+      else {
+        setReading(g_echoWidthUs * SPEED_OF_SOUND_MM_PER_MS / 2000);
+      }
+      g_echoState = echoIdle;
+      break;
+    }
+    return m_hasReading;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns true if an asynchronous reading is waiting to be collected
+  bool hasReading() {
+    return m_hasReading;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Collect the last asynchronous reading (mm, ULTRASONIC_BEYOND_RANGE, or -1 if no echo)
+  int getReadingMm() {
+    m_hasReading = false;
+    return m_readingMm;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Last asynchronous reading without collecting it (for diagnostics)
+  int peekReadingMm() {
+    return m_readingMm;
   }
 };
 
@@ -0,0 +1,106 @@
+// Closed-loop speed control for one side of the tank drive
+// Feedforward gets the power close for the requested speed, a PI loop on the encoder speed
+// trims out the rest (battery level, floor, motor differences).  All integer math.
+#ifndef VELOCITYCONTROLLER_H
+#define VELOCITYCONTROLLER_H
+
+#include "Hal.h"
+#include "TankDriveSide.h"
+#include "WheelEncoder.h"
+
+#define VELOCITY_PERIOD_US    10000   // Control rate (100Hz, see Drivetrain::update())
+
+// Feedforward: power = VELOCITY_KS + (speed * VELOCITY_KV >> 8), speed in mm/s
+#define VELOCITY_KS           40      // Power where the wheels just start to turn
+#define VELOCITY_KV           138     // Power per mm/s in Q8 (~215 power over 400mm/s)
+
+// PI on the speed error (Q4 mm/s).  Gains are in units of 1/2^VELOCITY_GAIN_SHIFT power, the
+// integral gain is per control period.
+#define VELOCITY_GAIN_SHIFT   12
+#define VELOCITY_KP           64      // 100mm/s error gives ~25 power
+#define VELOCITY_KI           4       // 100mm/s error adds ~160 power/s
+#define VELOCITY_MAX_POWER    255
+
+
+class VelocityController {
+private:
+  TankDriveSide *m_pSide;
+  WheelEncoder *m_pEncoder;
+  int m_targetMmps;
+  long m_integral;    // Integral term, in 1/2^VELOCITY_GAIN_SHIFT power
+
+public:
+  VelocityController() {}
+
+  ////////////////////////////////////////////////////////////////////
+  // Initializer (constructor wasn't a good place to do this)
+  void init(TankDriveSide *pSide, WheelEncoder *pEncoder) {
+    m_pSide = pSide;
+    m_pEncoder = pEncoder;
+    m_targetMmps = 0;
+    m_integral = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Set the target speed (mm/s, negative is reverse).  Takes effect on the next update().
+  // The encoders can't tell direction, so it comes from the target and the controller never
+  // drives against it (it lets the side coast down instead).
+  void setTarget(int mmps) {
+    if(mmps == 0 || (mmps > 0) != (m_targetMmps > 0)) {
+      m_integral = 0;
+    }
+    m_targetMmps = mmps;
+    if(mmps != 0) {
+      // Stopping leaves the direction alone while the side coasts down
+      m_pEncoder->setDirectionForward(mmps > 0);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Returns the target speed (mm/s)
+  int getTarget() {
+    return m_targetMmps;
+  }
+
+  ////////////////////////////////////////////////////////////////////
+  // Run one control period.  Call every VELOCITY_PERIOD_US (the integral gain assumes it).
+  void update() {
+    if(m_targetMmps == 0) {
+      m_pSide->setPower(0);
+      return;
+    }
+
+    // Work on magnitudes, the sign goes back on at the end
+    long target = (m_targetMmps > 0) ? m_targetMmps : -(long)m_targetMmps;
+    long measured = m_pEncoder->getVelocityMmPerSec();
+    if(measured < 0) {
+      measured = -measured;
+    }
+    long error = (target << VELOCITY_FRAC_BITS) - measured;
+
+    long power = VELOCITY_KS + ((target * VELOCITY_KV) >> 8) +
+                 ((error * VELOCITY_KP + m_integral) >> VELOCITY_GAIN_SHIFT);
+
+    // Only integrate while the output isn't pinned in the direction the error is pushing
+    if((power < VELOCITY_MAX_POWER || error < 0) && (power > 0 || error > 0)) {
+      m_integral += error * VELOCITY_KI;
+      long limit = (long)VELOCITY_MAX_POWER << VELOCITY_GAIN_SHIFT;
+      if(m_integral > limit) {
+        m_integral = limit;
+      }
+      else if(m_integral < -limit) {
+        m_integral = -limit;
+      }
+    }
+
+    if(power > VELOCITY_MAX_POWER) {
+      power = VELOCITY_MAX_POWER;
+    }
+    else if(power < 0) {
+      power = 0;
+    }
+    m_pSide->setPower((m_targetMmps > 0) ? (int)power : -(int)power);
+  }
+};
+
+#endif
@@ -2,55 +2,66 @@
 #ifndef WHEELENCODERS_H
 #define WHEELENCODERS_H
 
-// Need left and right side items because the interrupts don't work with class functions
-int g_leftCount = 0;
-int g_rightCount = 0;
-bool g_leftDirectionForward = false;
-bool g_rightDirectionForward = false;
-void leftTickIsr(void) {
-  if(g_leftDirectionForward) {
-    g_leftCount++;
-  }
-  else {
-    g_leftCount--;
+#include "Hal.h"
+#include "RobotMap.h"
+#include "FixedPoint.h"
+#include "FastIO.h"
+
+// Edges closer together than this are treated as glitches.  At full speed the encoders give
+// an edge every ~12ms so this leaves plenty of room.
+#define ENCODER_MIN_PULSE_US  1000
+
+// Velocity estimate
+#define VELOCITY_FRAC_BITS    4         // getVelocityMmPerSec() is in Q4 (1/16 mm/s)
+#define ENCODER_STALE_US      250000    // No edge for this long means stopped
+
+// Encoder state shared with the ISRs.  Need left and right side items because the interrupts
+// don't work with class functions.  Everything the ISRs touch is volatile and multi-byte values
+// must be read with interrupts off (see WheelEncoder::getDistanceInTicks()).
+struct EncoderIsrState {
+  volatile int count;
+  volatile bool forward;
+  volatile uint8_t lastLevel;
+  volatile unsigned long lastEdgeUs;  // Time of the last counted edge
+  volatile unsigned long prevEdgeUs;  // Time of the counted edge before that
+  volatile unsigned long cycleUs;     // Time across the last two counted edges (0 = none yet)
+};
+EncoderIsrState g_leftEncoder = { 0, false, LOW, 0, 0, 0 };
+EncoderIsrState g_rightEncoder = { 0, false, LOW, 0, 0, 0 };
+volatile unsigned int g_encoderMinPulseUs = ENCODER_MIN_PULSE_US;
+
+// Edge handling shared by both ISRs (a template so the pin read is a FastPin).
+// Glitch filter: an edge only counts if it comes at least g_encoderMinPulseUs after the last
+// counted edge and the pin has actually changed level since then.  A spike can count in place
+// of the next real edge, but the count never drifts because counted edges always alternate
+// levels.
+// Velocity: every counted edge is timestamped.  The time across two edges (one slot plus one
+// bar of the encoder wheel) is kept so an uneven slot/bar split doesn't show up as jitter.
+template<uint8_t PIN>
+inline void encoderEdge(EncoderIsrState &enc) {
+  unsigned long now = micros();
+  uint8_t level = FastPin<PIN>::read();
+  if(level == enc.lastLevel || (now - enc.lastEdgeUs) < g_encoderMinPulseUs) {
+    return;
   }
-#ifdef DRIVE_ONLY
-  Serial.print("L");
-  Serial.println(g_leftCount);
-#endif
-}
-
-void rightTickIsr(void) {
-  if(g_rightDirectionForward) {
-    g_rightCount++;
+  enc.lastLevel = level;
+  enc.cycleUs = now - enc.prevEdgeUs;
+  enc.prevEdgeUs = enc.lastEdgeUs;
+  enc.lastEdgeUs = now;
+  if(enc.forward) {
+    enc.count++;
   }
   else {
-    g_rightCount--;
+    enc.count--;
   }
-#ifdef DRIVE_ONLY
-  Serial.print("R");
-  Serial.println(g_rightCount);
-#endif
 }
 
-
-// Poll left encoder
-int g_pollCount = 0;
-void pollLeftEncoder() {
-  static bool lastEncoderState = false;
-  if(digitalRead(LEFT_WHEEL_ENCODER_PIN) != lastEncoderState)
-  {
-    lastEncoderState = !lastEncoderState;
-    if(g_leftDirectionForward) {
-      g_pollCount++;
-    }
-    else {
-      g_pollCount--;
-    }
-  }
+void leftTickIsr(void) {
+  encoderEdge<LEFT_WHEEL_ENCODER_PIN>(g_leftEncoder);
 }
-int getPollCount() {
-  return g_pollCount;
+
+void rightTickIsr(void) {
+  encoderEdge<RIGHT_WHEEL_ENCODER_PIN>(g_rightEncoder);
 }
 
 
@@ -58,9 +69,10 @@ int getPollCount() {
 class WheelEncoder {
 private:
   int m_encoderPin;
-  int *m_pCount;
-  bool *m_pForward;
-  float m_ticksToMmFactor;
+  EncoderIsrState *m_pState;
+  unsigned long m_ticksPerMmQ16;   // Ticks per mm in Q16
+  unsigned long m_mmPerTickQ12;    // Inverse of the above in Q12 (so mm = ticks * it >> 12)
+  unsigned long m_velocityScale;   // mm per edge in Q4, times 1000000us
 
 public:
   WheelEncoder() {}
@@ -70,69 +82,107 @@ public:
   // Initializer (constructor wasn't a good place to do this)
   void init(int encoderPin, bool leftSide) {
     m_encoderPin = encoderPin;
-    m_ticksToMmFactor = 1.0;
+    setTicksToDistanceFactor(TO_Q16(1.0));
 
-    // Setup the encoder to interrupt on rising and falling edges
+    // Setup the encoder to interrupt on rising and falling edges (INT0/INT1)
     pinMode(m_encoderPin, INPUT_PULLUP);
-    if( leftSide ) {
-      m_pCount = &g_leftCount;
-      m_pForward = &g_leftDirectionForward;
-      attachInterrupt(digitalPinToInterrupt(m_encoderPin), leftTickIsr, CHANGE);
-    }
-    else {
-      m_pCount = &g_rightCount;
-      m_pForward = &g_rightDirectionForward;
-      attachInterrupt(digitalPinToInterrupt(m_encoderPin), rightTickIsr, CHANGE);
-    } 
+    m_pState = leftSide ? &g_leftEncoder : &g_rightEncoder;
+    m_pState->lastLevel = digitalRead(m_encoderPin);
+    attachInterrupt(digitalPinToInterrupt(m_encoderPin), leftSide ? leftTickIsr : rightTickIsr, CHANGE);
+  }
+
+  /////////////////////////////////////////////////////////////
+  // Reset the encoder tick count to 0.  Returns the count from just before the reset (read in
+  // the same atomic section so no ticks get lost in between).
+  int reset(void) {
+    noInterrupts();
+    int count = m_pState->count;
+    m_pState->count = 0;
+    interrupts();
+    return count;
   }
 
   /////////////////////////////////////////////////////////////
-  // Reset the encoder tick count to 0
-  void reset(void) {
-    *m_pCount = 0;
-    g_pollCount = 0;
-    attachInterrupt(digitalPinToInterrupt(m_encoderPin), leftTickIsr, CHANGE);
+  // Get the mm per tick factor (Q12)
+  unsigned long getMmPerTickQ12(void) {
+    return m_mmPerTickQ12;
   }
 
   /////////////////////////////////////////////////////////////
   // Tell the encoder if ticks should increment or decrement the count
   void setDirectionForward(bool forward) {
-    *m_pForward = forward;
+    m_pState->forward = forward;
   }
 
   /////////////////////////////////////////////////////////////
-  // Sets the ticks to mm factor so we can work in mm instead of ticks
-  void setTicksToDistanceFactor(float factor) {
-    m_ticksToMmFactor = factor;
+  // Sets the ticks to mm factor (ticks per mm in Q16) so we can work in mm instead of ticks.
+  // The divisions here only happen once.
+  void setTicksToDistanceFactor(unsigned long factorQ16) {
+    m_ticksPerMmQ16 = factorQ16;
+    m_mmPerTickQ12 = ((1UL << 28) + factorQ16 / 2) / factorQ16;
+    m_velocityScale = m_mmPerTickQ12 * (1000000UL >> (12 - VELOCITY_FRAC_BITS));
   }
 
   /////////////////////////////////////////////////////////////
-  // Get distance in ticks
+  // Sets the glitch filter's minimum time between edges (shared by both encoders)
+  void setMinPulseWidthUs(unsigned int us) {
+    noInterrupts();
+    g_encoderMinPulseUs = us;
+    interrupts();
+  }
+
+  /////////////////////////////////////////////////////////////
+  // Get distance in ticks (read atomically since the ISR can change it mid-read)
   int getDistanceInTicks(void) {
-    return g_pollCount;//*m_pCount;
+    noInterrupts();
+    int count = m_pState->count;
+    interrupts();
+    return count;
   }
 
   /////////////////////////////////////////////////////////////
-  // Get current distance (uses expensive float calculation)
+  // Get current distance
   int getDistanceMm(void) {
-    return *m_pCount / m_ticksToMmFactor;
+    return getDistanceOfTicks(getDistanceInTicks());
+  }
+
+  /////////////////////////////////////////////////////////////
+  // Get the distance (mm) that a number of ticks represents
+  int getDistanceOfTicks(int ticks) {
+    return mulShift(ticks, m_mmPerTickQ12, 12);
   }
 
   /////////////////////////////////////////////////////////////
-  // Get number of ticks that represents the distance (quicker than getting mm)
+  // Get number of ticks that represents the distance
   int getNumTicksInDistance(int distanceMm) {
-#if 0
-    Serial.print("Ticks in Distance: ");
-    Serial.print(distanceMm);
-    Serial.print("mm = ");
-    Serial.print((float)distanceMm * m_ticksToMmFactor);
-    Serial.print("(f) or ");
-    Serial.print((int)((float)distanceMm * m_ticksToMmFactor));
-    Serial.println("(i) ticks");
-#endif    
-    return (int)((float)distanceMm * m_ticksToMmFactor);
+    return mulShift(distanceMm, m_ticksPerMmQ16, 16);
+  }
+
+  /////////////////////////////////////////////////////////////
+  // Get the wheel speed in Q4 fixed point (mm/s * 16, sign from the commanded direction).
+  // Counting ticks per control period is mostly quantization noise with these coarse wheels, so
+  // this uses the time between edges instead.  While no new edge comes in, the speed can be no
+  // more than one edge over the time since the last one, so the estimate decays towards zero
+  // and reads 0 after ENCODER_STALE_US.
+  long getVelocityMmPerSec(void) {
+    noInterrupts();
+    unsigned long lastEdgeUs = m_pState->lastEdgeUs;
+    unsigned long cycleUs = m_pState->cycleUs;
+    bool forward = m_pState->forward;
+    interrupts();
+
+    unsigned long sinceEdgeUs = micros() - lastEdgeUs;
+    if(cycleUs == 0 || sinceEdgeUs > ENCODER_STALE_US) {
+      return 0;
+    }
+    unsigned long edgeUs = (cycleUs + 1) / 2;
+    if(sinceEdgeUs > edgeUs) {
+      edgeUs = sinceEdgeUs;
+    }
+    long velocity = m_velocityScale / edgeUs;
+    return forward ? velocity : -velocity;
   }
-  
+
 };
 
 #endif
@@ -10,16 +10,12 @@
 #include "Elevator.h"
 #include "Timer.h"
 #include "UltrasonicSensor.h"
-
-
-// For debugging purposes
-#if 0 // Set to 1 to make the preprocessor replace all occurences of TRACE with Serial.println
-  // Print messages to the serial port / console
-  #define TRACE(x)  Serial.println(x)
-#else
-  // Replace all TRACE functions with nothing (i.e. don't print to console)
-  #define TRACE(x)
-#endif
+#include "CupDetector.h"
+#include "LoopProfiler.h"
+#include "CommandScheduler.h"
+#include "Telemetry.h"
+#include "EventLog.h"   // TRACE() and g_log
+#include "StackMonitor.h"
 
 
 // Controller Settings
@@ -48,6 +44,10 @@
 #define MAX_CUP_DISTANCE_MM     300
 #define CUP_PICKUP_DISTANCE_MM  90
 #define CUP_BACKOFF_DISTANCE_MM 30
+#define SCAN_STOP_MS            100   // For the robot to stop after a scan ends early
+#define CUP_SETTLE_MS           150   // After the gripper stops, for a dropped cup to fall in or a stack to settle
+#define ELEVATOR_CARRY_MM       40    // Cups clear of the floor for driving
+#define ELEVATOR_PLATFORM_MM    60    // Cups clear of the drop-off platform
 
 
 // Create hardware objects
@@ -55,39 +55,188 @@ Drivetrain drivetrain;  // DC motors, etc.
 DriverStation ds;       // Joystick/controller and game flow
 Elevator elevator;
 Gripper gripper;
-Timer timer;
 UltrasonicSensor ultrasonic;
+CupDetector g_cupDetector;   // For the scan in handleScanAndAlignToCup()
+CommandScheduler g_scheduler;
+#ifdef LOOP_PROFILER
+LoopProfiler g_loopProfiler;
+#endif
+#ifdef TELEMETRY
+Telemetry g_telemetry;
+#endif
 
 
 // Globals
 bool g_firstTimeInAuto = true;
-struct CommandSequenceController {
-  bool isRunning;             // Whether or not a command is running
-  void (*handleCmdSeq)(void); // Function pointer to the command handler
-  int param;                  // Parameter for function (use varies by handler)
-  int curStep;                // Current step in the command sequence
-  int lastAlignDistance;      // Holds the distance from the last align command
-} g_cmdSeqCtrl;
+uint8_t g_autoTimer = NO_TIMER; // Simple line follower auto: stops it after a while
+bool g_autoTimeUp = false;
+int g_lastAlignDistance = 0;  // Holds the distance from the last align command
+long g_cupXMm = 0;            // Field position of the last cup found (see Odometry.h)
+long g_cupYMm = 0;
+
+
+// Function prototypes
+// The Arduino builder generates these automatically but the host build (../host) doesn't.
+void teleop();
+void autonomous();
+void autoTimeUp();
+void startCommand(const CommandDef *pDef, int param);
+void handleElevatorToBottom(Command &cmd);
+void handleElevatorToTop(Command &cmd);
+void handleElevatorTo(Command &cmd);
+void handleAlignToCup(Command &cmd);
+void handleScanAndAlignToCup(Command &cmd);
+void handleRotate(Command &cmd);
+void handleDrive(Command &cmd);
+void handleDriveToCup(Command &cmd);
+void handleDriveToLine(Command &cmd);
+void handleLineFollow(Command &cmd);
+void waitForDriveMove(Command &cmd);
+void handleGripperOpen(Command &cmd);
+void handleGripperClose(Command &cmd);
+void handleWait(Command &cmd);
+void waitForGripper(Command &cmd);
+int calcCupAngle(int scanEndTicks, int *pDistance);
+void recordCupPosition(int distanceMm);
+void sendTelemetry();
+
+
+// Commands (see CommandScheduler.h): handler, subsystems it uses, type.  These and the step
+// tables are all in flash; a new routine is a step table built from the building blocks.
+#define NUM_STEPS(steps)  (sizeof(steps) / sizeof(steps[0]))
+const CommandDef cmdElevatorToBottom PROGMEM = { handleElevatorToBottom, REQ_ELEVATOR, cmdSingle, NULL, 0 };
+const CommandDef cmdElevatorToTop PROGMEM = { handleElevatorToTop, REQ_ELEVATOR, cmdSingle, NULL, 0 };
+const CommandDef cmdAlignToCup PROGMEM = { handleAlignToCup, REQ_DRIVETRAIN | REQ_ELEVATOR, cmdSingle, NULL, 0 };
+const CommandDef cmdScanAndAlignToCup PROGMEM = { handleScanAndAlignToCup, REQ_DRIVETRAIN | REQ_ELEVATOR, cmdSingle, NULL, 0 };
+
+// Building blocks for the groups (the param comes from the group step)
+const CommandDef cmdElevatorTo PROGMEM = { handleElevatorTo, REQ_ELEVATOR, cmdSingle, NULL, 0 };      // mm above the bottom
+const CommandDef cmdRotate PROGMEM = { handleRotate, REQ_DRIVETRAIN, cmdSingle, NULL, 0 };            // deg
+const CommandDef cmdDrive PROGMEM = { handleDrive, REQ_DRIVETRAIN, cmdSingle, NULL, 0 };              // mm
+const CommandDef cmdDriveToCup PROGMEM = { handleDriveToCup, REQ_DRIVETRAIN, cmdSingle, NULL, 0 };    // Last align distance
+const CommandDef cmdDriveToLine PROGMEM = { handleDriveToLine, REQ_DRIVETRAIN, cmdSingle, NULL, 0 };
+const CommandDef cmdLineFollow PROGMEM = { handleLineFollow, REQ_DRIVETRAIN, cmdSingle, NULL, 0 };    // Never ends
+const CommandDef cmdGripperOpen PROGMEM = { handleGripperOpen, REQ_GRIPPER, cmdSingle, NULL, 0 };     // ms to wait once open
+const CommandDef cmdGripperClose PROGMEM = { handleGripperClose, REQ_GRIPPER, cmdSingle, NULL, 0 };   // ms to wait once closed
+const CommandDef cmdWait PROGMEM = { handleWait, REQ_NONE, cmdSingle, NULL, 0 };                      // ms
+
+// Drive up to the first cup and grip it.  Distance is based on the align command's measured
+// distance.
+const CommandStep firstCupPickupSteps[] PROGMEM = {
+  { &cmdGripperOpen, 0 },
+  { &cmdElevatorToBottom, 0 },
+  { &cmdDriveToCup, 0 },
+  { &cmdGripperClose, 0 }
+};
+const CommandDef cmd1stCupPickup PROGMEM = { NULL, REQ_NONE, cmdSequential, firstCupPickupSteps, NUM_STEPS(firstCupPickupSteps) };
+
+// Drive the first cup over the second one (at the align command's distance), drop it in, back
+// off, lower and grab the stack.
+const CommandStep secondCupPickupSteps[] PROGMEM = {
+  { &cmdElevatorToTop, 0 },
+  { &cmdDriveToCup, 0 },
+  { &cmdGripperOpen, CUP_SETTLE_MS },             // Let 1st cup drop into 2nd one
+  { &cmdDrive, -CUP_BACKOFF_DISTANCE_MM },        // So elevator doesn't hit cups on way down
+  { &cmdElevatorToBottom, 0 },
+  { &cmdDrive, CUP_BACKOFF_DISTANCE_MM },
+  { &cmdGripperClose, 0 }
+};
+const CommandDef cmd2ndCupPickup PROGMEM = { NULL, REQ_NONE, cmdSequential, secondCupPickupSteps, NUM_STEPS(secondCupPickupSteps) };
+
+// Drive half the field to check that the encoders are correct
+#define HALF_FIELD_DISTANCE_MM  905
+const CommandStep driveTestSteps[] PROGMEM = { { &cmdDrive, HALF_FIELD_DISTANCE_MM } };
+const CommandDef cmdDriveTest PROGMEM = { NULL, REQ_NONE, cmdSequential, driveTestSteps, NUM_STEPS(driveTestSteps) };
+
+// Rotate a set amount to test the encoders
+#define ROTATE_TEST_DEG 90
+const CommandStep rotateTestSteps[] PROGMEM = { { &cmdRotate, ROTATE_TEST_DEG } };
+const CommandDef cmdRotateTest PROGMEM = { NULL, REQ_NONE, cmdSequential, rotateTestSteps, NUM_STEPS(rotateTestSteps) };
+
+// Raise the elevator while turning in place (turning doesn't swing the gripper into anything)
+const CommandStep raiseAndRotateToCup1Steps[] PROGMEM = { { &cmdElevatorToTop, 0 }, { &cmdRotate, -65 } };
+const CommandDef cmdRaiseAndRotateToCup1 PROGMEM = { NULL, REQ_NONE, cmdParallel, raiseAndRotateToCup1Steps, NUM_STEPS(raiseAndRotateToCup1Steps) };
+const CommandStep raiseAndRotateToCup2Steps[] PROGMEM = { { &cmdElevatorToTop, 0 }, { &cmdRotate, -15 } };
+const CommandDef cmdRaiseAndRotateToCup2 PROGMEM = { NULL, REQ_NONE, cmdParallel, raiseAndRotateToCup2Steps, NUM_STEPS(raiseAndRotateToCup2Steps) };
+const CommandStep raiseAndRotateToLineSteps[] PROGMEM = { { &cmdElevatorTo, ELEVATOR_CARRY_MM }, { &cmdRotate, -60 } };
+const CommandDef cmdRaiseAndRotateToLine PROGMEM = { NULL, REQ_NONE, cmdParallel, raiseAndRotateToLineSteps, NUM_STEPS(raiseAndRotateToLineSteps) };
+
+// Auto: pick-up and stack two cups near the starting zone and bring them to Zone D
+const CommandStep autoSteps[] PROGMEM = {
+  { &cmdRaiseAndRotateToCup1, 0 },
+  { &cmdElevatorToBottom, 0 },
+  { &cmdDrive, 30 },                      // Drive to the cup
+  { &cmdGripperClose, 0 },
+  { &cmdRaiseAndRotateToCup2, 0 },
+  { &cmdDrive, 110 },                     // Drive forward to 2nd cup
+  { &cmdWait, 500 },                      // Stop for a bit so the cup isn't thrown
+  { &cmdGripperOpen, CUP_SETTLE_MS },
+  { &cmdDrive, -30 },                     // Back up a bit (so elevator doesn't hit cups on way down)
+  { &cmdElevatorToBottom, 0 },
+  { &cmdDrive, 30 },
+  { &cmdGripperClose, CUP_SETTLE_MS },    // Grab the cups and wait for things to stabilize
+  { &cmdRaiseAndRotateToLine, 0 },
+  { &cmdDriveToLine, 0 },
+  { &cmdLineFollow, 0 }                   // Until the end of auto
+};
+const CommandDef cmdAuto PROGMEM = { NULL, REQ_NONE, cmdSequential, autoSteps, NUM_STEPS(autoSteps) };
+
+// Once the first cup is in the gripper, the elevator is all the way up and the first cup is
+// positioned over the second cup: drop it in, back off, lower, grab the stack and raise it.
+// The elevator has to wait for the back-off so it doesn't hit the cups on the way down.
+const CommandStep dropAnd2ndCupPickupSteps[] PROGMEM = {
+  { &cmdGripperOpen, CUP_SETTLE_MS },     // First cup falls into second cup
+  { &cmdDrive, -CUP_BACKOFF_DISTANCE_MM },
+  { &cmdElevatorToBottom, 0 },
+  { &cmdDrive, CUP_BACKOFF_DISTANCE_MM },
+  { &cmdGripperClose, CUP_SETTLE_MS },
+  { &cmdElevatorTo, ELEVATOR_PLATFORM_MM } // Platform-drop-off-height
+};
+const CommandDef cmdDropAnd2ndCupPickup PROGMEM = { NULL, REQ_NONE, cmdSequential, dropAnd2ndCupPickupSteps, NUM_STEPS(dropAnd2ndCupPickupSteps) };
 
 
 ////////////////////////////////////////////////////////////////////
 // Arduino setup function.  Called on power-up.
 void setup() {
-  g_cmdSeqCtrl.isRunning = false;
+  g_scheduler.init();
   drivetrain.init();
   elevator.init();
   gripper.init();
+  ultrasonic.init();
+#ifdef TELEMETRY
+  g_telemetry.init();
+#endif
   
   Serial.begin( 115200 );
-  Serial.println( "Elegoo Robot v4.2" );
+  Serial.println( F( "Elegoo Robot v4.2" ) );
 }
 
 
 ////////////////////////////////////////////////////////////////////
 // Main Arduino loop function.  Called continuously
 void loop() {
+  bool newData;
+
+#ifdef LOOP_PROFILER
+  g_loopProfiler.loopStart();
+#endif
+
   // Update the Driver Station state and check if new data has been received (10 times/second)
-  if(ds.bUpdate()) {
+  PROFILE(profDsUpdate, newData = ds.bUpdate());
+  if(newData) {
+#ifdef LOOP_PROFILER
+    // Dump the loop profile, the DriverStation link status and the SRAM use when the button is
+    // pressed (once per press)
+    static bool lastDumpBtn = false;
+    bool dumpBtn = ds.getButton(PROFILE_DUMP_BTN);
+    if(dumpBtn && !lastDumpBtn) {
+      g_loopProfiler.requestDump();
+      ds.vPrintStatus();
+      printMemoryStatus();
+    }
+    lastDumpBtn = dumpBtn;
+#endif
+
     // Act based on game state
     switch(ds.getGameState()) {
     case ePreGame:
@@ -96,10 +245,7 @@ void loop() {
       g_firstTimeInAuto = true;
       
       // Stop any running commands
-      if(g_cmdSeqCtrl.isRunning) {
-        g_cmdSeqCtrl.isRunning = false;
-        g_cmdSeqCtrl.handleCmdSeq();
-      }
+      g_scheduler.cancelAll();
       
       // During Pre and Post game, the Elegoo should not move!
       drivetrain.setPower(0, 0);
@@ -113,24 +259,40 @@ void loop() {
       
     case eTeleop:
       // Handle telop mode
-      teleop();
+      PROFILE(profTeleop, teleop());
       break;
     }
   }
 
   // Kick off auto command if in auto
   if(ds.getGameState() == eAutonomous) {
-    autonomous();
+    PROFILE(profAutonomous, autonomous());
   }
 
-  // If a command sequence is running, service it now
-  if(g_cmdSeqCtrl.isRunning) {
-    g_cmdSeqCtrl.handleCmdSeq();
+  // Timer callbacks, then the running command sequences
+  g_timers.service();
+  PROFILE(profCmdSeq, g_scheduler.run());
+
+  // Closed-loop drive control (runs at its own fixed rate)
+  PROFILE(profDrive, drivetrain.update());
+
+  // Elevator height estimate and moves to a height, slowed gripper moves
+  PROFILE(profMechanisms, elevator.update(); gripper.update());
+
+  // Send a queued log record if Serial has room
+  PROFILE(profLog, g_log.service());
+
+#ifdef TELEMETRY
+  // Robot state snapshot (at its own rate)
+  if(g_telemetry.update()) {
+    sendTelemetry();
   }
+#endif
 
-  // Poll the wheel encoder
-  // Hack.  Interrupts were inconsistent (sometimes the robot would move half, or twice, the distance).
-  pollLeftEncoder();
+#ifdef LOOP_PROFILER
+  // Print the profile if asked (outside the timed stages)
+  g_loopProfiler.service();
+#endif
 }
 
 
@@ -141,19 +303,19 @@ void autonomous() {
     // Setup auto command
     if(g_firstTimeInAuto) {
       g_firstTimeInAuto = false;
-      g_cmdSeqCtrl.handleCmdSeq = &handleAuto;
-      g_cmdSeqCtrl.isRunning = true;
-      g_cmdSeqCtrl.curStep = 0;
-      g_cmdSeqCtrl.handleCmdSeq();
+      drivetrain.getOdometry().reset();  // Field coordinates start where auto starts
+      g_scheduler.schedule(&cmdAuto);
     }
 #else // Simple line follower.  Set above to "#if 0" to disable above and use this instead
     if(g_firstTimeInAuto) {
       g_firstTimeInAuto = false;
-      timer.set(7000);
+      g_autoTimeUp = false;
+      g_timers.cancel(g_autoTimer);   // In case the last auto was cut short
+      g_autoTimer = g_timers.startMs(7000, autoTimeUp);
     }
 
     // Hack to get the robot to stop somewhere in Zone D
-    if(timer.isExpired()) {
+    if(g_autoTimeUp) {
       drivetrain.setPower(0, 0);
     }
     else {
@@ -163,6 +325,12 @@ void autonomous() {
 
 }
 
+////////////////////////////////////////////////////////////////////
+// g_timers callback for the simple line follower auto
+void autoTimeUp() {
+  g_autoTimeUp = true;
+}
+
 
 ////////////////////////////////////////////////////////////////////
 // Teleop mode
@@ -187,18 +355,55 @@ void teleop() {
 
   // Check for the command-cancel buttons
   if(ds.getButton(CANCEL1_BTN) || ds.getButton(CANCEL2_BTN)) {
-    // Make sure there's something to cancel
-    if(g_cmdSeqCtrl.isRunning) {
-      // Setting 'running' to false and calling the handler will cause it to stop gracefully
-      g_cmdSeqCtrl.isRunning = false;
-      g_cmdSeqCtrl.handleCmdSeq();
-    } 
+    // Cancelling calls each running handler with isRunning false so it stops gracefully
+    g_scheduler.cancelAll();
   }
-  
-  // Only respond to these inputs if no command is running
-  if(!g_cmdSeqCtrl.isRunning) {
-    // /Let the joysticks control the robot
-    
+
+  // Command-sequence buttons.  A command cancels any running command that needs the same
+  // subsystems.  Anything the running commands don't need stays under joystick control below,
+  // so you can, for example, keep driving while the elevator is moving to the bottom.
+  if(ds.getButton(ELEVATOR_TO_BOT_BTN)) {
+    startCommand(&cmdElevatorToBottom, 0);
+  }
+  else if(ds.getButton(ELEVATOR_TO_TOP_BTN)) {
+    startCommand(&cmdElevatorToTop, 0);
+  }
+  else if(ds.getButton(ALIGN_TO_CUP_L_BTN)) {
+#ifdef SCAN_AND_ALIGN 
+    // Scan and align uses the ultrasonic sensor and rotates the robot to find the closest cup.  
+    // The speed and accuracy of the sensor was not good enough to make this easier than manually lining up.
+    startCommand(&cmdScanAndAlignToCup, 0); // 0 = left-hand turn
+#else
+    startCommand(&cmdAlignToCup, 0);        // 0 = left-hand turn
+#endif
+  }
+  else if(ds.getButton(ALIGN_TO_CUP_R_BTN)) {
+#ifdef SCAN_AND_ALIGN
+    startCommand(&cmdScanAndAlignToCup, 1); // 1 = right-hand turn
+#else
+    startCommand(&cmdAlignToCup, 1);        // 1 = right-hand turn
+#endif
+  }
+  else if(ds.getButton(GRAB_1ST_CUP_BTN)) {
+    startCommand(&cmd1stCupPickup, 0);
+  }
+  else if(ds.getButton(DRP_AND_2ND_CUP_BTN)) {
+    startCommand(&cmdDropAnd2ndCupPickup, 0);
+  }
+  else if(ds.getButton(GRAB_2ND_CUP_BTN)) {
+    startCommand(&cmd2ndCupPickup, 0);      // 0 = left-hand turn
+  }
+  else if(ds.getButton(DRIVE_TEST_BTN)) {
+    startCommand(&cmdDriveTest, 0);
+  }
+  else if(ds.getButton(ROTATE_TEST_BTN)) {
+    startCommand(&cmdRotateTest, 0);
+  }
+
+  // Let the joysticks control whatever the commands aren't using
+  uint8_t busy = g_scheduler.getBusySubsystems();
+
+  if(!(busy & REQ_DRIVETRAIN)) {
     // Drive
     // - LY is used for forward/backward drive speed
     // - RX is used for turning speed
@@ -213,7 +418,9 @@ void teleop() {
       rotatePower = 0;
     }
     drivetrain.drive(drivePower, rotatePower);
+  }
 
+  if(!(busy & REQ_ELEVATOR)) {
     // Elevator
     // - LT is used to lower
     // - RT is used to raise
@@ -236,8 +443,9 @@ void teleop() {
       servoPower = 0;
     }
     elevator.setPower(servoPower);
+  }
 
-    // Now react to button presses
+  if(!(busy & REQ_GRIPPER)) {
     // Single-action buttons
     if(ds.getButton(GRIPPER_OPEN_BTN)) {
       gripper.open();
@@ -245,292 +453,51 @@ void teleop() {
     else if(ds.getButton(GRIPPER_CLOSE_BTN)) {
       gripper.close();
     }
-
-    // Command-sequence buttons
-    // For now, don't let anything else happen while a command sequence is running.
-    // In the future, could improve so you could, for example, keep driving while
-    // the elevator is moving to the bottom.
-    if(ds.getButton(ELEVATOR_TO_BOT_BTN)) {
-      g_cmdSeqCtrl.handleCmdSeq = &handleElevatorToBottom;
-      g_cmdSeqCtrl.isRunning = true;
-    }
-    else if(ds.getButton(ELEVATOR_TO_TOP_BTN)) {
-      g_cmdSeqCtrl.handleCmdSeq = &handleElevatorToTop;
-      g_cmdSeqCtrl.isRunning = true;
-    }
-    else if(ds.getButton(ALIGN_TO_CUP_L_BTN)) {
-#ifdef SCAN_AND_ALIGN 
-      // Scan and align uses the ultrasonic sensor and rotates the robot to find the closest cup.  
-      // The speed and accuracy of the sensor was not good enough to make this easier than manually lining up.
-      g_cmdSeqCtrl.handleCmdSeq = &handleScanAndAlignToCup;
-#else
-      g_cmdSeqCtrl.handleCmdSeq = &handleAlignToCup;
-#endif
-      g_cmdSeqCtrl.param = 0; // 0 = left-hand turn
-      g_cmdSeqCtrl.isRunning = true;
-    }
-    else if(ds.getButton(ALIGN_TO_CUP_R_BTN)) {
-#ifdef SCAN_AND_ALIGN
-      g_cmdSeqCtrl.handleCmdSeq = &handleScanAndAlignToCup;
-#else
-      g_cmdSeqCtrl.handleCmdSeq = &handleAlignToCup;
-#endif
-      g_cmdSeqCtrl.param = 1; // 1 = right-hand turn
-      g_cmdSeqCtrl.isRunning = true;
-    }
-    else if(ds.getButton(GRAB_1ST_CUP_BTN)) {
-      g_cmdSeqCtrl.handleCmdSeq = &handle1stCupPickup;
-      g_cmdSeqCtrl.isRunning = true;
-    }
-    else if(ds.getButton(DRP_AND_2ND_CUP_BTN)) {
-      g_cmdSeqCtrl.handleCmdSeq = &handleDropAnd2ndCupPickup;
-      g_cmdSeqCtrl.isRunning = true;
-    }
-    else if(ds.getButton(GRAB_2ND_CUP_BTN)) {
-      g_cmdSeqCtrl.handleCmdSeq = &handle2ndCupPickup;
-      g_cmdSeqCtrl.param = 0; // 0 = left-hand turn
-      g_cmdSeqCtrl.isRunning = true;
-    }
-    else if(ds.getButton(DRIVE_TEST_BTN)) {
-      g_cmdSeqCtrl.handleCmdSeq = &handleDriveTest;
-      g_cmdSeqCtrl.isRunning = true;
-    }
-    else if(ds.getButton(ROTATE_TEST_BTN)) {
-      g_cmdSeqCtrl.handleCmdSeq = &handleRotateTest;
-      g_cmdSeqCtrl.isRunning = true;
-    }
-    
-    // If a new command has started, start running it now
-    if(g_cmdSeqCtrl.isRunning) {
-      g_cmdSeqCtrl.curStep = 0;
-      g_cmdSeqCtrl.handleCmdSeq();
-    }
-      
   }
 #endif
 }
 
 
 ////////////////////////////////////////////////////////////////////
-// Special command sequence for auto
-// Pick-up and stack two cups near the starting zone and bring them
-// to Zone D.
-void handleAuto() {
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
-    case 0:     
-      // Raise elevator
-      elevator.setPower(256);
-      g_cmdSeqCtrl.curStep++;
-      break;
-
-    case 1:
-      // Check if elevator is raised
-      if(elevator.isAtUpperLimit()) {
-        elevator.setPower(0);
-
-        // Start turning
-        drivetrain.autoRotate(-65);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-    
-    case 2:
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Done turning.  Lower elevator
-        elevator.setPower(-256);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 3:
-      if(elevator.isAtLowerLimit()) {
-        elevator.setPower(0);
-
-        // Drive to the cup.
-        drivetrain.autoDistance(30);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-
-    case 4:
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Done driving.  Close gripper
-        gripper.close();
-        g_cmdSeqCtrl.curStep++;
-        // Wait until gripper closes
-        timer.set(500);
-      }
-      break;
-      
-    case 5:
-      // Check if we've waited long enough
-      if(timer.isExpired()) {
-        // Raise the elevator
-        elevator.setPower(256);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-
-    case 6:
-      // Check if elevator is raised
-      if(elevator.isAtUpperLimit()) {
-        elevator.setPower(0);
-
-        // Start turning
-        drivetrain.autoRotate(-15);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-
-    case 7:
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Done turning.  Drive forward to 2nd cup.
-        drivetrain.autoDistance(110);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-
-    case 8:
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Stop for a big so the cup isn't thrown
-        timer.set(500);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-
-    case 9:
-      if(timer.isExpired()) {  
-        // Open gripper
-        gripper.open();
-        g_cmdSeqCtrl.curStep++;
-        // Wait until gripper opens
-        timer.set(500);
-      }
-      break;
-
-    case 10:
-      // Check if we've waited long enough
-      if(timer.isExpired()) {
-        // Back up a bit (so elevator doesn't hit cups on way down)
-        drivetrain.autoDistance(-30);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 11:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Lower elevator to pick-up-height
-        elevator.setPower(-256);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 12:
-      // Check if elevator is lowered
-      if(elevator.isAtLowerLimit()) {
-        // Stop the elevator and drive forward 30mm
-        elevator.setPower(0);
-        drivetrain.autoDistance(30);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 13:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Close the gripper to grab the cups and then wait for things to stabilize
-        gripper.close();
-        timer.set(500);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 14:
-      // Check if we've waited long enough
-      if(timer.isExpired()) {
-        // Raise elevator to platform-drop-off-height
-        elevator.setPower(256);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 15:
-      // Check if elevator is raised
-      if(elevator.isAtUpperLimit()) {
-        // Rotate to the line-follow line
-        drivetrain.autoRotate(-60);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-
-    case 16:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Drive to the line-follow line
-        drivetrain.autoDriveToLine();
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-
-    case 17:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-
-    case 18:
-      // Line follow until the end of auto
-      drivetrain.autoLineFollow();
-      //g_cmdSeqCtrl.isRunning = false;
-      break;
-    }
+// Start a command from a button press.  Holding the button doesn't restart it.  Manual
+// control of the subsystems the command takes over is stopped first.
+void startCommand(const CommandDef *pDef, int param) {
+  if(g_scheduler.isScheduled(pDef)) {
+    return;
   }
-  
-  // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
-    drivetrain.abortAuto();
+  uint8_t requirements = CommandScheduler::getRequirements(pDef);
+  if(requirements & REQ_DRIVETRAIN) {
     drivetrain.drive(0, 0);
+  }
+  if(requirements & REQ_ELEVATOR) {
     elevator.setPower(0);
-    printDistanceLog();
-    TRACE("CMD DONE: Auto");
   }
+  g_scheduler.schedule(pDef, param);
 }
 
 
 ////////////////////////////////////////////////////////////////////
 // Moves the elevator down until it hits the lower limit switch
-void handleElevatorToBottom() {
+void handleElevatorToBottom(Command &cmd) {
   // Make sure the sequence hasn't been cancelled
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
+  if(cmd.isRunning) {
+    switch(cmd.curStep) {
     case 0:
       // Start lowering the elevator
-      drivetrain.drive(0, 0);
       elevator.setPower(-256);
-      g_cmdSeqCtrl.curStep++;
+      cmd.curStep++;
       // no break;
     case 1:
       // Check if the lower limit switch has been triggered
       if(elevator.isAtLowerLimit()) {
-        g_cmdSeqCtrl.isRunning = false;
+        cmd.isRunning = false;
       }
       break;
     }
   }
 
   // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
+  if(!cmd.isRunning) {
     elevator.setPower(0);
     TRACE("CMD DONE: E to bot");
   }        
@@ -539,46 +506,73 @@ void handleElevatorToBottom() {
 
 ////////////////////////////////////////////////////////////////////
 // Moves the elevator up until it hits the upper limit switch
-void handleElevatorToTop() {
+void handleElevatorToTop(Command &cmd) {
   // Make sure the sequence hasn't been cancelled
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
+  if(cmd.isRunning) {
+    switch(cmd.curStep) {
     case 0:
       // Start raising the elevator
-      drivetrain.drive(0, 0);
       elevator.setPower(256);
-      g_cmdSeqCtrl.curStep++;
+      cmd.curStep++;
       // no break;
     case 1:
       // Check if the lower limit switch has been triggered
       if(elevator.isAtUpperLimit()) {
-        g_cmdSeqCtrl.isRunning = false;
+        cmd.isRunning = false;
       }
       break;
     }
   }
 
   // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
+  if(!cmd.isRunning) {
     elevator.setPower(0);
     TRACE("CMD DONE: E to top");
   }        
 }
 
 
+////////////////////////////////////////////////////////////////////
+// Moves the elevator to a height (cmd.param, mm above the bottom).  Slows down near the
+// height, see Elevator::moveTo().
+void handleElevatorTo(Command &cmd) {
+  // Make sure the sequence hasn't been cancelled
+  if(cmd.isRunning) {
+    switch(cmd.curStep) {
+    case 0:
+      elevator.moveTo(cmd.param);
+      cmd.curStep++;
+      // no break;
+    case 1:
+      // Elevator::update() does the move
+      if(!elevator.isMoving()) {
+        cmd.isRunning = false;
+      }
+      break;
+    }
+  }
+
+  // If command finished or was stopped, clean up
+  if(!cmd.isRunning) {
+    elevator.setPower(0);
+    TRACE(elevator.getHeightMm());
+  }        
+}
+
+
 ////////////////////////////////////////////////////////////////////
 // Align the robot to a cup within range.  Can rotate left of right.
-void handleAlignToCup() {
+void handleAlignToCup(Command &cmd) {
   static bool foundPossibleCup = false;
   
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
+  if(cmd.isRunning) {
+    switch(cmd.curStep) {
     case 0:
-      g_cmdSeqCtrl.lastAlignDistance = 0;
+      g_lastAlignDistance = 0;
       
       // Raise elevator
       elevator.setPower(256);
-      g_cmdSeqCtrl.curStep++;
+      cmd.curStep++;
       break;
 
     case 1:
@@ -587,8 +581,8 @@ void handleAlignToCup() {
         elevator.setPower(0);
 
         // Start turning
-        drivetrain.autoRotate((g_cmdSeqCtrl.param == 0) ? -MAX_SEARCH_ROTATE_DEG : MAX_SEARCH_ROTATE_DEG);
-        g_cmdSeqCtrl.curStep++;
+        drivetrain.autoRotate((cmd.param == 0) ? -MAX_SEARCH_ROTATE_DEG : MAX_SEARCH_ROTATE_DEG);
+        cmd.curStep++;
       }
       break;
     
@@ -596,43 +590,49 @@ void handleAlignToCup() {
       drivetrain.updateAuto();
       if(drivetrain.isAutoIdle()) {
         // Quit if we've turned too far and haven't found a cup
-        g_cmdSeqCtrl.isRunning = false;
+        cmd.isRunning = false;
       }
       else {
-        // Check if we've found a cup close by
-        int distance = ultrasonic.getDistanceMm();
-        logDistance(distance);
-        if((distance > 0) && (distance < MAX_CUP_DISTANCE_MM)) {
-          // Don't jump at the first cup with think we see
-          if(foundPossibleCup) {
-            // This is the second time we've seen an object so assume it's not a glitch
-            // Stop turning and calculate how far we are from the cup
-            drivetrain.abortAuto();
-            TRACE(distance);
-            g_cmdSeqCtrl.lastAlignDistance = distance - CUP_PICKUP_DISTANCE_MM;
-            foundPossibleCup = false;
-            // Done
-            g_cmdSeqCtrl.isRunning = false;
+        // Check if we've found a cup close by.  The ultrasonic pings in the background so the
+        // loop (and the encoder polling) keeps running while the sound is in flight.
+        if(ultrasonic.poll()) {
+          int distance = ultrasonic.getReadingMm();
+          g_log.log(logUltrasonic, distance);
+          if((distance > 0) && (distance < MAX_CUP_DISTANCE_MM)) {
+            // Don't jump at the first cup with think we see
+            if(foundPossibleCup) {
+              // This is the second time we've seen an object so assume it's not a glitch
+              // Stop turning and calculate how far we are from the cup
+              drivetrain.abortAuto();
+              TRACE(distance);
+              g_lastAlignDistance = distance - CUP_PICKUP_DISTANCE_MM;
+              recordCupPosition(distance);
+              foundPossibleCup = false;
+              // Done
+              cmd.isRunning = false;
+            }
+            else {
+              foundPossibleCup = true;
+              TRACE(distance);
+            }
           }
           else {
-            foundPossibleCup = true;
-            TRACE(distance);
+            foundPossibleCup = false;
           }
         }
-        else {
-          foundPossibleCup = false;
-        }
+
+        // Start the next ping (ignored while one is in flight).  Only listen out to the cup range.
+        ultrasonic.trigger(MAX_CUP_DISTANCE_MM);
       }
       break;
     }
   }
   
   // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
+  if(!cmd.isRunning) {
     drivetrain.abortAuto();
     drivetrain.drive(0, 0);
     elevator.setPower(0);
-    printDistanceLog();
     TRACE("CMD DONE: Align");
   }
 }
@@ -640,19 +640,17 @@ void handleAlignToCup() {
 
 ////////////////////////////////////////////////////////////////////
 // Scan an arc for a cup and align to the middle of the detection
-// range.  Can rotate left of right.
-void handleScanAndAlignToCup() {
-  static bool foundPossibleCup = false;
-  
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
+// range.  Can rotate left of right.  The scan stops as soon as it's gone past the cup.
+void handleScanAndAlignToCup(Command &cmd) {
+  if(cmd.isRunning) {
+    switch(cmd.curStep) {
     case 0:
-      g_cmdSeqCtrl.lastAlignDistance = 0;
-      resetDistanceLog();
+      g_lastAlignDistance = 0;
+      g_cupDetector.reset(MAX_CUP_DISTANCE_MM);
       
       // Raise elevator
       elevator.setPower(256);
-      g_cmdSeqCtrl.curStep++;
+      cmd.curStep++;
       break;
 
     case 1:
@@ -662,468 +660,257 @@ void handleScanAndAlignToCup() {
 
         // Scan a full arc
         // param = 0 means left turn, 1 means right turn
-        drivetrain.autoRotate((g_cmdSeqCtrl.param == 0) ? -MAX_SEARCH_ROTATE_DEG : MAX_SEARCH_ROTATE_DEG);
-        g_cmdSeqCtrl.curStep++;
+        drivetrain.autoRotate((cmd.param == 0) ? -MAX_SEARCH_ROTATE_DEG : MAX_SEARCH_ROTATE_DEG);
+        cmd.curStep++;
       }
       break;
     
     case 2:
       drivetrain.updateAuto();
       if(drivetrain.isAutoIdle()) {
-        // Get the angle to the centre of the cup and get the distance the cup is at
-        int cupAngle = calcCupAngle(&g_cmdSeqCtrl.lastAlignDistance);
-        // Turn to that angle
-        drivetrain.autoRotate((g_cmdSeqCtrl.param == 0) ? cupAngle : -cupAngle);
-        g_cmdSeqCtrl.curStep++;
+        // Turned the whole arc
+        cmd.timer.set(0);
+        cmd.curStep++;
       }
       else {
-        // Measure the distance and record it
-        int distance = ultrasonic.getDistanceMm();
-        logDistance(distance);
+        // Feed each distance measurement to the detector as it comes in (with how far the robot
+        // has turned) and start the next one
+        if(ultrasonic.poll()) {
+          int distance = ultrasonic.getReadingMm();
+          g_log.log(logUltrasonic, distance);
+          if(g_cupDetector.addReading(distance, drivetrain.getRotateTicks())) {
+            // Past the cup, no need to turn any further.  Let the robot stop before working out
+            // how far back to turn, so the ticks it coasts are turned back too.
+            drivetrain.abortAuto();
+            cmd.timer.set(SCAN_STOP_MS);
+            cmd.curStep++;
+            break;
+          }
+        }
+        ultrasonic.trigger(MAX_CUP_DISTANCE_MM);
       }
       break;
 
     case 3:
+      if(cmd.timer.isExpired()) {
+        // Get the angle back to the centre of the cup and get the distance the cup is at
+        int cupAngle = calcCupAngle(drivetrain.getRotateTicks(), &g_lastAlignDistance);
+        // Turn to that angle
+        drivetrain.autoRotate((cmd.param == 0) ? cupAngle : -cupAngle);
+        cmd.curStep++;
+      }
+      break;
+
+    case 4:
       drivetrain.updateAuto();
       if(drivetrain.isAutoIdle()) {
-        g_cmdSeqCtrl.isRunning = false;
+        if(g_lastAlignDistance > 0) {
+          recordCupPosition(g_lastAlignDistance);
+        }
+        cmd.isRunning = false;
       }
       break;
     }
   }
   
   // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
+  if(!cmd.isRunning) {
     drivetrain.abortAuto();
     drivetrain.drive(0, 0);
     elevator.setPower(0);
-    printDistanceLog();
     TRACE("CMD DONE: Scan and Align");
   }
 }
 
 
 ////////////////////////////////////////////////////////////////////
-// Drive up to the first cup and grip it.  Distance is based on the
-// align command's measured distance.
-void handle1stCupPickup() {
-  static int distanceToDrive = 0;
-  static bool foundPossibleCup = false;
-  
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
-    case 0:
-      // Open the gripper
-      gripper.open();
-      g_cmdSeqCtrl.curStep++;
-      // Wait until gripper opens
-      timer.set(500);
-      break;
-      
-    case 1:
-      // Check if we've waited long enough
-      if(timer.isExpired()) {
-        // Lower elevator
-        elevator.setPower(-256);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-    
-    case 2:
-      // Check if elevator is lowered
-      if(elevator.isAtLowerLimit()) {
-        elevator.setPower(0);
-        // Drive to the cup using pre-calculated distance
-        drivetrain.autoDistance(g_cmdSeqCtrl.lastAlignDistance);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
+// Building blocks for the command groups.  These only touch the subsystems they declare so
+// they can run alongside each other.
 
-    case 3:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Close the gripper to grab the cup and then wait for things to stabilize
-        gripper.close();
-        g_cmdSeqCtrl.isRunning = false;
-      }
-      break;
-    }
-  }
-  
-  // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
-    drivetrain.abortAuto();
-    drivetrain.drive(0, 0);
-    elevator.setPower(0);
-    printDistanceLog();
-    TRACE("CMD DONE: 1st Cup");
+////////////////////////////////////////////////////////////////////
+// Turn in place (param = deg, negative is counter-clockwise)
+void handleRotate(Command &cmd) {
+  if(cmd.isRunning && cmd.curStep == 0) {
+    drivetrain.autoRotate(cmd.param);
+    cmd.curStep++;
   }
+  waitForDriveMove(cmd);
 }
 
-
 ////////////////////////////////////////////////////////////////////
-// Once the first cup is in the gripper, the elevator is all the way
-// up and the first cup is positioned over the second cup:
-// - Open the gripper
-// - Wait a bit
-// - Backup a bit
-// - Lower the elevator
-// - Drive up to the stack of cups
-// - Close the gripper
-// - Wait a bit
-// - Raise the elevator
-void handleDropAnd2ndCupPickup() {
-  // Make sure the sequence hasn't been cancelled
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
-    case 0:
-      // Open gripper (first cup falls into second cup)
-      TRACE("CMD: 2nd cup");
-      drivetrain.drive(0, 0);
-      elevator.setPower(0);
-      gripper.open();
-      g_cmdSeqCtrl.curStep++;
-      
-      // Wait until gripper opens and cup falls
-      timer.set(500);
-      break;
-      
-    case 1:
-      // Check if we've waited long enough
-      if(timer.isExpired()) {
-        // Back up a bit (so elevator doesn't hit cups on way down)
-        drivetrain.autoDistance(-30);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 2:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Lower elevator to pick-up-height
-        elevator.setPower(-256);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 3:
-      // Check if elevator is lowered
-      if(elevator.isAtLowerLimit()) {
-        // Stop the elevator and drive forward 30mm
-        elevator.setPower(0);
-        drivetrain.autoDistance(30);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 4:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Close the gripper to grab the cups and then wait for things to stabilize
-        gripper.close();
-        timer.set(500);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 5:
-      // Check if we've waited long enough
-      if(timer.isExpired()) {
-        // Raise elevator to platform-drop-off-height
-        elevator.setPower(256);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 6:
-      // Check if elevator is raised
-      if(elevator.isAtUpperLimit()) {
-        g_cmdSeqCtrl.isRunning = false;
-      }
-      break;
-    }
-  }
-
-  // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
-    drivetrain.abortAuto();
-    drivetrain.drive(0, 0);
-    elevator.setPower(0);
-    TRACE("CMD DONE: 2nd cup");
+// Drive straight (param = mm, negative is backwards)
+void handleDrive(Command &cmd) {
+  if(cmd.isRunning && cmd.curStep == 0) {
+    drivetrain.autoDistance(cmd.param);
+    cmd.curStep++;
   }
+  waitForDriveMove(cmd);
 }
 
-
 ////////////////////////////////////////////////////////////////////
-// Same as the previous 2nd-cup grab function but advances based on
-// the align command's distance measurement
-void handle2ndCupPickup() {  
-  static bool foundPossibleCup = false;
-  
-  // Make sure the sequence hasn't been cancelled
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
-   case 0:
-      // Raise elevator
-      elevator.setPower(256);
-      g_cmdSeqCtrl.curStep++;
-      break;
-
-    case 1:
-      // Check if elevator is raised
-      if(elevator.isAtUpperLimit()) {
-        elevator.setPower(0);
- 
-        // Drive to the cup
-        drivetrain.autoDistance(g_cmdSeqCtrl.lastAlignDistance);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-
-    case 2:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Open gripper to let 1st cup drop into 2nd one
-        gripper.open();
-        // Wait until gripper opens and cup falls
-        timer.set(500);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 3:
-      // Check if we've waited long enough
-      if(timer.isExpired()) {
-        // Back up a bit (so elevator doesn't hit cups on way down)
-        drivetrain.autoDistance(-CUP_BACKOFF_DISTANCE_MM);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 4:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Lower elevator to pick-up-height
-        elevator.setPower(-256);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 5:
-      // Check if elevator is lowered
-      if(elevator.isAtLowerLimit()) {
-        // Stop the elevator and drive forward 30mm
-        elevator.setPower(0);
-        drivetrain.autoDistance(CUP_BACKOFF_DISTANCE_MM);
-        g_cmdSeqCtrl.curStep++;
-      }
-      break;
-      
-    case 6:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Close the gripper to grab the cups and done
-        gripper.close();
-        g_cmdSeqCtrl.isRunning = false;
-      }
-      break;
-    }
+// Drive the distance measured by the last align command
+void handleDriveToCup(Command &cmd) {
+  if(cmd.isRunning && cmd.curStep == 0) {
+    drivetrain.autoDistance(g_lastAlignDistance);
+    cmd.curStep++;
   }
+  waitForDriveMove(cmd);
+}
 
-  // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
-    drivetrain.abortAuto();
-    drivetrain.drive(0, 0);
-    elevator.setPower(0);
-    printDistanceLog();
-    TRACE("CMD DONE: 2nd cup rot");
+////////////////////////////////////////////////////////////////////
+// Drive until the middle line sensor sees a line
+void handleDriveToLine(Command &cmd) {
+  if(cmd.isRunning && cmd.curStep == 0) {
+    drivetrain.autoDriveToLine();
+    cmd.curStep++;
   }
+  waitForDriveMove(cmd);
 }
 
-
 ////////////////////////////////////////////////////////////////////
-// Drive half the field to check that the encoders are correct
-#define HALF_FIELD_DISTANCE_MM  905
-void handleDriveTest() {
-   // Make sure the sequence hasn't been cancelled
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
-    case 0:
-        // Drive the set distance
-        drivetrain.autoDistance(HALF_FIELD_DISTANCE_MM);
-        g_cmdSeqCtrl.curStep++;
-      break;
-
-    case 1:
-      // Update the drivetrain state machine and check if the move is done
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        g_cmdSeqCtrl.isRunning = false;
-      }
-      break;
+// Finish a drivetrain auto move: done when the drivetrain goes idle
+void waitForDriveMove(Command &cmd) {
+  if(cmd.isRunning) {
+    drivetrain.updateAuto();
+    if(drivetrain.isAutoIdle()) {
+      cmd.isRunning = false;
     }
   }
 
   // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
+  if(!cmd.isRunning) {
     drivetrain.abortAuto();
-    drivetrain.setPower(0, 0);
-    elevator.setPower(0);
-    TRACE("CMD DONE: Drive Test");
   }
 }
 
-
 ////////////////////////////////////////////////////////////////////
-// Rotate a set amount to test the encoders
-#define ROTATE_TEST_DEG 90
-void handleRotateTest() {
-  if(g_cmdSeqCtrl.isRunning) {
-    switch(g_cmdSeqCtrl.curStep) {
-    case 0:
-      // Start turning
-      drivetrain.autoRotate(ROTATE_TEST_DEG);
-      g_cmdSeqCtrl.curStep++;
-      break;
-    
-    case 1:
-      drivetrain.updateAuto();
-      if(drivetrain.isAutoIdle()) {
-        // Done turning
-        g_cmdSeqCtrl.isRunning = false;
-      }
-      break;
-    }
+// Follow the line until cancelled
+void handleLineFollow(Command &cmd) {
+  if(cmd.isRunning) {
+    drivetrain.autoLineFollow();
   }
-  
-  // If command finished or was stopped, clean up
-  if(!g_cmdSeqCtrl.isRunning) {
+  else {
     drivetrain.abortAuto();
-    drivetrain.drive(0, 0);
-    elevator.setPower(0);
-    printDistanceLog();
-    TRACE("CMD DONE: Rotate Test");
   }
 }
 
-
 ////////////////////////////////////////////////////////////////////
-// Save a set of distances for debugging purposes
-#define DISTANCE_LOG_LENGTH 200
-int distanceLog[DISTANCE_LOG_LENGTH];
-int distanceLogIdx = 0;
-void logDistance(int distance) {
-  distanceLog[distanceLogIdx] = distance;
-  if(++distanceLogIdx >= DISTANCE_LOG_LENGTH) {
-    distanceLogIdx = 0;
-    TRACE("Distance Log Full");
+// Open the gripper, wait for it to open, then wait param ms
+void handleGripperOpen(Command &cmd) {
+  if(cmd.isRunning && cmd.curStep == 0) {
+    gripper.open();
+    cmd.curStep++;
   }
+  waitForGripper(cmd);
 }
 
-
 ////////////////////////////////////////////////////////////////////
-// Print out the distance log
-void printDistanceLog() {
-  for(int idx; idx < distanceLogIdx; idx++) {
-    Serial.print(distanceLog[idx]);
-    Serial.print(",");
+// Close the gripper, wait for it to close, then wait param ms
+void handleGripperClose(Command &cmd) {
+  if(cmd.isRunning && cmd.curStep == 0) {
+    gripper.close();
+    cmd.curStep++;
   }
-  Serial.println("");
-  resetDistanceLog();
+  waitForGripper(cmd);
 }
 
-
 ////////////////////////////////////////////////////////////////////
-// Reset the log index
-void resetDistanceLog() {
-  distanceLogIdx = 0;
+// Shared by the gripper commands: wait for the jaws to stop moving (see Gripper::isSettled()),
+// then param ms more
+void waitForGripper(Command &cmd) {
+  if(cmd.isRunning) {
+    if(cmd.curStep == 1) {
+      if(gripper.isSettled()) {
+        cmd.timer.set(cmd.param);
+        cmd.curStep++;
+      }
+    }
+    else if(cmd.timer.isExpired()) {
+      cmd.isRunning = false;
+    }
+  }
 }
 
-
 ////////////////////////////////////////////////////////////////////
-// Find the centre of the set of closet measurements.  Return the 
-// angle to counter rotate to get there and the distance to that cup
-#define NEW_CUP_DIST_MM 50
-int calcCupAngle(int *pDistance) {
-  // Assume we haven't found anything close enough
-  int angle = 0;
-  if(pDistance) *pDistance = 0;
-
-  int scanningState = 0;
-  int cupStartIdx = -1;
-  int cupEndIdx = -1;
-  for(int idx = 0; idx <= distanceLogIdx; idx++) {
-    if(distanceLog[idx] == -1) {
-      // Could be too close or too far.  Don't know so ignore
-      continue;
+// Wait param ms
+void handleWait(Command &cmd) {
+  if(cmd.isRunning) {
+    if(cmd.curStep == 0) {
+      cmd.timer.set(cmd.param);
+      cmd.curStep++;
     }
-    switch(scanningState) {
-    case 0:
-      // Start by trying to find something that's below threshold
-      if(distanceLog[idx] < MAX_CUP_DISTANCE_MM) {
-        cupStartIdx = idx;
-        scanningState++;
-      }
-      break;
-      
-    case 1:
-      // We have found the start of a cup.  Now check for two things:
-      // - A closer cup (140 vs 150)
-      // - The end of that cup (200 vs 150)
-      if((distanceLog[cupStartIdx] - distanceLog[idx]) > NEW_CUP_DIST_MM) {
-        // Found a closer cup, reset the start index
-        cupStartIdx = idx;
-      }
-      else if((distanceLog[idx] - distanceLog[cupStartIdx]) > NEW_CUP_DIST_MM) {
-        // Found the end of the cup
-        cupEndIdx = idx - 1;
-        scanningState++;
-      }
-
-    case 2:
-      // TODO:  Break out of the for loop
-      break;
+    else if(cmd.timer.isExpired()) {
+      cmd.isRunning = false;
     }
   }
+}
+
 
-  // Act on what we found
-  if(cupStartIdx == -1) {
+////////////////////////////////////////////////////////////////////
+// Angle to turn back to the centre of the cup the scan found (0 if none), and the distance the
+// cup is at.  scanEndTicks is where the scan turn ended (see Drivetrain::getRotateTicks()).
+int calcCupAngle(int scanEndTicks, int *pDistance) {
+  if(pDistance) *pDistance = 0;
+  if(!g_cupDetector.hasCup()) {
     // Didn't find a cup
     return 0;
   }
-  
-  if(cupEndIdx == -1) {
-    // Didn't find the end of the cup so assume the last entry is the end
-    cupEndIdx = distanceLogIdx;
-    Serial.println("No cup end found");
+  if(!g_cupDetector.isFound()) {
+    // Didn't find the end of the cup so assume it's where the scan ended
+    TRACE("No cup end found");
   }
 
-  // Calculate the angle to the centre of the cup
-  // angle-to-cup = ((last-idx - cup-centre-idx) / last-idx) * overall-scan-angle
-  int centreIdx = (cupEndIdx - cupStartIdx + 1) / 2 + cupStartIdx;
-  angle = ((distanceLogIdx - centreIdx) / (float)distanceLogIdx) * MAX_SEARCH_ROTATE_DEG;
+  int centreTicks = g_cupDetector.getCentreTicks(scanEndTicks);
+  int angle = Drivetrain::rotateTicksToDeg(scanEndTicks - centreTicks);
   if(pDistance) {
-    *pDistance = distanceLog[centreIdx];
+    *pDistance = g_cupDetector.getDistanceMm();
   }
 
-  Serial.print("Cup S");
-  Serial.print(cupStartIdx);
-  Serial.print(" E");
-  Serial.print(cupEndIdx);
-  Serial.print(" C");
-  Serial.print(centreIdx);
-  Serial.print(" L");
-  Serial.print(distanceLogIdx);
-  Serial.print(" A");
-  Serial.print(angle);
-  Serial.print(" D");
-  Serial.println(*pDistance);
+  g_log.log(logCupScan, centreTicks, scanEndTicks, angle, pDistance ? *pDistance : 0);
 
   return angle;
 }
+
+
+////////////////////////////////////////////////////////////////////
+// Store the field position of a cup distanceMm straight ahead of the robot
+void recordCupPosition(int distanceMm) {
+  drivetrain.getOdometry().getPointAhead(distanceMm, &g_cupXMm, &g_cupYMm);
+  g_log.log(logCupPosition, g_cupXMm, g_cupYMm);
+}
+
+
+#ifdef TELEMETRY
+////////////////////////////////////////////////////////////////////
+// Fill in a telemetry packet with the robot state and send it (see Telemetry.h)
+void sendTelemetry() {
+  TelemetryData data;
+  Odometry &odometry = drivetrain.getOdometry();
+  const DsStatus &dsStatus = ds.getStatus();
+
+  data.i16LeftTicks = drivetrain.getLeftTicks();
+  data.i16RightTicks = drivetrain.getRightTicks();
+  data.i16XMm = odometry.getXMm();
+  data.i16YMm = odometry.getYMm();
+  data.u16Heading = odometry.getHeading();
+  data.i16LeftPower = drivetrain.getLeftPower();
+  data.i16RightPower = drivetrain.getRightPower();
+  data.i16ElevatorPower = elevator.getPower();
+  data.i16UltrasonicMm = ultrasonic.peekReadingMm();
+  data.i8CmdStep = g_scheduler.getStep();
+  data.u8Busy = g_scheduler.getBusySubsystems();
+
+  uint8_t line = drivetrain.readLineSensors();
+  data.u8Flags = 0;
+  if(elevator.isAtLowerLimit()) data.u8Flags |= TELEM_ELEVATOR_LOWER;
+  if(elevator.isAtUpperLimit()) data.u8Flags |= TELEM_ELEVATOR_UPPER;
+  if(line & LINE_LEFT) data.u8Flags |= TELEM_LINE_LEFT;
+  if(line & LINE_MIDDLE) data.u8Flags |= TELEM_LINE_MIDDLE;
+  if(line & LINE_RIGHT) data.u8Flags |= TELEM_LINE_RIGHT;
+  if(gripper.isOpen()) data.u8Flags |= TELEM_GRIPPER_OPEN;
+
+  data.u8LinkErrors = dsStatus.u16BadVersion + dsStatus.u16BadSize + dsStatus.u16BadChecksum;
+
+  g_telemetry.send(data);
+}
+#endif
@@ -0,0 +1,456 @@
+// Host (native Linux) backend for the hardware abstraction layer
+#include "HalHost.h"
+
+#include <time.h>
+#include <deque>
+
+// Simulated pin state
+struct HostPin {
+  uint8_t mode;
+  uint8_t level;
+  int pwm;
+  int analog;
+  unsigned long pulseWidth;
+  int servoAngle;
+  unsigned long riseCount;
+  void (*isr)(void);
+  int isrMode;
+  bool isrPending;
+};
+static HostPin s_pins[NUM_DIGITAL_PINS];
+static bool s_pinsInitialized = false;
+static bool s_interruptsEnabled = true;
+
+// Clock
+static bool s_virtualClock = false;
+static uint64_t s_spentUs = 0;  // Time "spent" in blocking calls and hostAdvanceMicros()
+static bool s_timeOverride = false;
+static unsigned long s_overrideUs = 0;  // micros() while an ISR runs from hostSetPinAt()
+
+// Serial
+HostSerial Serial;
+static std::deque<uint8_t> s_serialIn;
+static FILE *s_serialOut = stdout;
+static unsigned long s_serialBytesWritten = 0;
+static int s_serialTxFree = 63;
+
+// Digital I/O call counts
+static unsigned long s_coreIoCount = 0;
+static unsigned long s_fastIoCount = 0;
+
+
+////////////////////////////////////////////////////////////////////
+// Pins default to inputs reading high with no servo attached
+static HostPin &hostPin(uint8_t pin) {
+  if(!s_pinsInitialized) {
+    for(int i = 0; i < NUM_DIGITAL_PINS; i++) {
+      s_pins[i].mode = INPUT;
+      s_pins[i].level = HIGH;
+      s_pins[i].pwm = 0;
+      s_pins[i].analog = -1;
+      s_pins[i].pulseWidth = 0;
+      s_pins[i].servoAngle = -1;
+      s_pins[i].riseCount = 0;
+      s_pins[i].isr = NULL;
+      s_pins[i].isrMode = 0;
+      s_pins[i].isrPending = false;
+    }
+    s_pinsInitialized = true;
+  }
+  return s_pins[pin < NUM_DIGITAL_PINS ? pin : 0];
+}
+
+static uint64_t realMicros() {
+  static struct timespec start = { 0, 0 };
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if(start.tv_sec == 0 && start.tv_nsec == 0) {
+    start = now;
+  }
+  return (uint64_t)(now.tv_sec - start.tv_sec) * 1000000ULL + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+static uint64_t nowMicros() {
+  return (s_virtualClock ? 0 : realMicros()) + s_spentUs;
+}
+
+
+////////////////////////////////////////////////////////////////////
+// Arduino core
+void pinMode(uint8_t pin, uint8_t mode) {
+  hostPin(pin).mode = mode;
+}
+
+static void writePin(uint8_t pin, uint8_t val) {
+  HostPin &p = hostPin(pin);
+  if(val && !p.level) {
+    p.riseCount++;
+  }
+  p.level = val ? HIGH : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  s_coreIoCount++;
+  writePin(pin, val);
+}
+
+int digitalRead(uint8_t pin) {
+  s_coreIoCount++;
+  return hostPin(pin).level;
+}
+
+int analogRead(uint8_t pin) {
+  HostPin &p = hostPin(pin);
+  if(p.analog >= 0) {
+    return p.analog;
+  }
+  return p.level ? 1023 : 0;
+}
+
+void analogWrite(uint8_t pin, int val) {
+  HostPin &p = hostPin(pin);
+  p.pwm = val;
+  p.level = (val >= 128) ? HIGH : LOW;
+}
+
+unsigned long millis(void) {
+  if(s_timeOverride) {
+    return (uint32_t)(s_overrideUs / 1000);
+  }
+  return (uint32_t)(nowMicros() / 1000);
+}
+
+unsigned long micros(void) {
+  if(s_timeOverride) {
+    return (uint32_t)s_overrideUs;
+  }
+  return (uint32_t)nowMicros();
+}
+
+void delay(unsigned long ms) {
+  s_spentUs += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+  s_spentUs += us;
+}
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout) {
+  // Only models the pulse itself (the robot only uses HIGH pulses)
+  unsigned long width = hostPin(pin).pulseWidth;
+  if(width == 0 || width > timeout) {
+    s_spentUs += timeout;
+    return 0;
+  }
+  s_spentUs += width;
+  return width;
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(void), int mode) {
+  HostPin &p = hostPin(interruptNum == 0 ? 2 : 3);
+  p.isr = isr;
+  p.isrMode = mode;
+  p.isrPending = false;
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+  hostPin(interruptNum == 0 ? 2 : 3).isr = NULL;
+}
+
+void noInterrupts(void) {
+  s_interruptsEnabled = false;
+}
+
+void interrupts(void) {
+  s_interruptsEnabled = true;
+  // Run anything that was latched while interrupts were off
+  for(int i = 0; i < NUM_DIGITAL_PINS; i++) {
+    if(s_pins[i].isrPending) {
+      s_pins[i].isrPending = false;
+      if(s_pins[i].isr) {
+        s_pins[i].isr();
+      }
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////
+// PinChangeInt library
+int8_t PCintPort::attachInterrupt(uint8_t pin, void (*userFunc)(void), int mode) {
+  HostPin &p = hostPin(pin);
+  p.isr = userFunc;
+  p.isrMode = mode;
+  p.isrPending = false;
+  return 0;
+}
+
+void PCintPort::detachInterrupt(uint8_t pin) {
+  hostPin(pin).isr = NULL;
+}
+
+
+////////////////////////////////////////////////////////////////////
+// Serial port
+void HostSerial::begin(unsigned long baud) {
+}
+
+int HostSerial::available(void) {
+  return (int)s_serialIn.size();
+}
+
+int HostSerial::read(void) {
+  if(s_serialIn.empty()) {
+    return -1;
+  }
+  int c = s_serialIn.front();
+  s_serialIn.pop_front();
+  return c;
+}
+
+int HostSerial::peek(void) {
+  return s_serialIn.empty() ? -1 : s_serialIn.front();
+}
+
+int HostSerial::availableForWrite(void) {
+  // The host never blocks.  Report the Uno's empty TX buffer (64 bytes, one slot unused)
+  // unless a test says otherwise.
+  return s_serialTxFree;
+}
+
+void HostSerial::flush(void) {
+  if(s_serialOut) {
+    fflush(s_serialOut);
+  }
+}
+
+size_t HostSerial::write(uint8_t c) {
+  s_serialBytesWritten++;
+  if(s_serialOut) {
+    fputc(c, s_serialOut);
+  }
+  return 1;
+}
+
+size_t HostSerial::write(const uint8_t *buf, size_t len) {
+  s_serialBytesWritten += len;
+  if(s_serialOut) {
+    fwrite(buf, 1, len, s_serialOut);
+  }
+  return len;
+}
+
+size_t HostSerial::print(const char *s) {
+  size_t n = 0;
+  while(*s) {
+    n += write((uint8_t)*s++);
+  }
+  return n;
+}
+
+size_t HostSerial::print(const __FlashStringHelper *s) {
+  return print(reinterpret_cast<const char *>(s));
+}
+
+size_t HostSerial::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t HostSerial::print(unsigned char n, int base) {
+  return printNumber(n, base);
+}
+
+size_t HostSerial::print(int n, int base) {
+  return print((long)n, base);
+}
+
+size_t HostSerial::print(unsigned int n, int base) {
+  return printNumber(n, base);
+}
+
+size_t HostSerial::print(long n, int base) {
+  if(base == DEC && n < 0) {
+    return print('-') + printNumber((unsigned long)-n, base);
+  }
+  return printNumber((unsigned long)n, base);
+}
+
+size_t HostSerial::print(unsigned long n, int base) {
+  return printNumber(n, base);
+}
+
+size_t HostSerial::print(double n, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return print(buf);
+}
+
+size_t HostSerial::println(void) {
+  return print("\r\n");
+}
+
+size_t HostSerial::printNumber(unsigned long n, int base) {
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if(base < 2) {
+    base = 10;
+  }
+  do {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while(n);
+  return print(str);
+}
+
+
+////////////////////////////////////////////////////////////////////
+// Servo library (angle only, no pulse timing)
+Servo::Servo() : m_pin(-1) {}
+
+uint8_t Servo::attach(int pin) {
+  m_pin = pin;
+  return 0;
+}
+
+uint8_t Servo::attach(int pin, int minUs, int maxUs) {
+  return attach(pin);
+}
+
+void Servo::detach(void) {
+  m_pin = -1;
+}
+
+void Servo::write(int angle) {
+  if(angle < 0) {
+    angle = 0;
+  }
+  else if(angle > 180) {
+    angle = 180;
+  }
+  if(m_pin >= 0) {
+    hostPin(m_pin).servoAngle = angle;
+  }
+}
+
+void Servo::writeMicroseconds(int us) {
+  // Same mapping as the Arduino library (544us..2400us = 0..180deg)
+  write((int)(((long)us - 544) * 180 / (2400 - 544)));
+}
+
+int Servo::read(void) {
+  return (m_pin >= 0) ? hostPin(m_pin).servoAngle : -1;
+}
+
+bool Servo::attached(void) {
+  return m_pin >= 0;
+}
+
+
+////////////////////////////////////////////////////////////////////
+// Host-only hooks
+void hostSetPin(uint8_t pin, uint8_t val) {
+  HostPin &p = hostPin(pin);
+  uint8_t level = val ? HIGH : LOW;
+  if(level == p.level) {
+    return;
+  }
+  p.level = level;
+
+  // Edge-triggered interrupt
+  if(p.isr && (p.isrMode == CHANGE ||
+               (p.isrMode == RISING && level == HIGH) ||
+               (p.isrMode == FALLING && level == LOW))) {
+    if(s_interruptsEnabled) {
+      p.isr();
+    }
+    else {
+      p.isrPending = true;
+    }
+  }
+}
+
+void hostSetPinAt(uint8_t pin, uint8_t val, unsigned long us) {
+  s_timeOverride = true;
+  s_overrideUs = us;
+  hostSetPin(pin, val);
+  s_timeOverride = false;
+}
+
+int hostGetPin(uint8_t pin) {
+  return hostPin(pin).level;
+}
+
+unsigned long hostGetPinRiseCount(uint8_t pin) {
+  return hostPin(pin).riseCount;
+}
+
+int hostGetPwm(uint8_t pin) {
+  return hostPin(pin).pwm;
+}
+
+void hostSetAnalog(uint8_t pin, int val) {
+  hostPin(pin).analog = val;
+}
+
+void hostSetPulseWidth(uint8_t pin, unsigned long us) {
+  hostPin(pin).pulseWidth = us;
+}
+
+int hostGetServo(uint8_t pin) {
+  return hostPin(pin).servoAngle;
+}
+
+void hostUseVirtualClock(bool virtualClock) {
+  s_virtualClock = virtualClock;
+}
+
+void hostAdvanceMicros(unsigned long us) {
+  s_spentUs += us;
+}
+
+void hostSerialInject(const uint8_t *data, size_t len) {
+  s_serialIn.insert(s_serialIn.end(), data, data + len);
+}
+
+void hostSerialSetOutput(FILE *out) {
+  s_serialOut = out;
+}
+
+unsigned long hostSerialBytesWritten(void) {
+  return s_serialBytesWritten;
+}
+
+void hostSerialSetTxFree(int bytes) {
+  s_serialTxFree = bytes;
+}
+
+int hostFastRead(uint8_t pin) {
+  s_fastIoCount++;
+  return hostPin(pin).level;
+}
+
+void hostFastWrite(uint8_t pin, uint8_t val) {
+  s_fastIoCount++;
+  writePin(pin, val);
+}
+
+uint8_t hostFastReadPort(uint8_t firstPin, uint8_t mask) {
+  s_fastIoCount++;
+  uint8_t value = 0;
+  for(uint8_t bit = 0; bit < 8; bit++) {
+    if((mask & (1 << bit)) && hostPin(firstPin + bit).level) {
+      value |= 1 << bit;
+    }
+  }
+  return value;
+}
+
+unsigned long hostGetCoreIoCount(void) {
+  return s_coreIoCount;
+}
+
+unsigned long hostGetFastIoCount(void) {
+  return s_fastIoCount;
+}
@@ -0,0 +1,184 @@
+// Host (native Linux) backend for the hardware abstraction layer
+// Provides the subset of the Arduino API used by elegoo_robot so the sketch can run on a PC.
+// - Pins are simulated in memory.  Inputs are driven with the host hooks at the bottom.
+// - Time is the real monotonic clock plus any time "spent" in delay(), delayMicroseconds() and
+//   pulseIn() (those return immediately but advance the clock), so blocking calls still show
+//   up in timing measurements.  millis() and micros() wrap at 32 bits like on the Uno.
+// - Serial reads from an injectable buffer and writes to stdout (or a file, or nowhere).
+#ifndef HALHOST_H
+#define HALHOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>  // Arduino.h pulls this in too
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+#define CHANGE        1
+#define FALLING       2
+#define RISING        3
+#define DEC           10
+#define HEX           16
+#define PI            3.1415926535897932384626433832795
+
+// Arduino Uno pin numbering
+#define NUM_DIGITAL_PINS  20
+#define A0                14
+#define A1                15
+#define A2                16
+#define A3                17
+#define A4                18
+#define A5                19
+#define NOT_AN_INTERRUPT  -1
+#define digitalPinToInterrupt(p)  ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+
+// Arduino core
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000L);
+void attachInterrupt(uint8_t interruptNum, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+void noInterrupts(void);
+void interrupts(void);
+
+// Program memory (avr/pgmspace.h).  The host has one address space so these are plain reads.
+#define PROGMEM
+#define pgm_read_byte(addr)   (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)   (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)  (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr)    (*(void * const *)(addr))
+#define memcpy_P(dest, src, n)  memcpy(dest, src, n)
+
+// Strings in flash (F("text")), printed by Serial like any other string
+class __FlashStringHelper;
+#define F(str)  (reinterpret_cast<const __FlashStringHelper *>(str))
+
+
+////////////////////////////////////////////////////////////////////
+// Serial port
+class HostSerial {
+public:
+  void begin(unsigned long baud);
+  int available(void);
+  int read(void);
+  int peek(void);
+  int availableForWrite(void);
+  void flush(void);
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buf, size_t len);
+
+  size_t print(const char *s);
+  size_t print(const __FlashStringHelper *s);
+  size_t print(char c);
+  size_t print(unsigned char n, int base = DEC);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println(void);
+  template<typename T> size_t println(T value) {
+    size_t n = print(value);
+    return n + println();
+  }
+  template<typename T> size_t println(T value, int format) {
+    size_t n = print(value, format);
+    return n + println();
+  }
+
+private:
+  size_t printNumber(unsigned long n, int base);
+};
+
+extern HostSerial Serial;
+
+
+////////////////////////////////////////////////////////////////////
+// Servo library
+class Servo {
+private:
+  int m_pin;
+public:
+  Servo();
+  uint8_t attach(int pin);
+  uint8_t attach(int pin, int minUs, int maxUs);
+  void detach(void);
+  void write(int angle);
+  void writeMicroseconds(int us);
+  int read(void);
+  bool attached(void);
+};
+
+
+////////////////////////////////////////////////////////////////////
+// PinChangeInt library (any pin can interrupt)
+class PCintPort {
+public:
+  static int8_t attachInterrupt(uint8_t pin, void (*userFunc)(void), int mode);
+  static void detachInterrupt(uint8_t pin);
+};
+
+#define attachPinChangeInterrupt(pin, userFunc, mode)  PCintPort::attachInterrupt(pin, &userFunc, mode)
+#define detachPinChangeInterrupt(pin)                  PCintPort::detachInterrupt(pin)
+
+
+////////////////////////////////////////////////////////////////////
+// Host-only hooks (used by the simulator, tests and benchmarks)
+
+// Drive an input pin.  Fires the attached interrupt (if any) when the level changes.
+void hostSetPin(uint8_t pin, uint8_t val);
+// Same, but the interrupt sees micros() == us (for edges that happened part way through a step)
+void hostSetPinAt(uint8_t pin, uint8_t val, unsigned long us);
+// Last level written to a pin (digitalWrite, or analogWrite >= 128)
+int hostGetPin(uint8_t pin);
+// Number of low to high transitions written to a pin
+unsigned long hostGetPinRiseCount(uint8_t pin);
+// Last duty cycle written with analogWrite (0..255)
+int hostGetPwm(uint8_t pin);
+// Set the value returned by analogRead (0..1023)
+void hostSetAnalog(uint8_t pin, int val);
+// Pulse width returned by pulseIn on this pin (0 = no echo, pulseIn times out)
+void hostSetPulseWidth(uint8_t pin, unsigned long us);
+// Last angle written to the servo attached to this pin (-1 if none)
+int hostGetServo(uint8_t pin);
+
+// Clock control.  With the virtual clock on, time only moves with hostAdvanceMicros() and the
+// blocking calls, which makes runs deterministic.
+void hostUseVirtualClock(bool virtualClock);
+void hostAdvanceMicros(unsigned long us);
+
+// Queue bytes to be read from Serial
+void hostSerialInject(const uint8_t *data, size_t len);
+// Where Serial output goes (NULL discards it)
+void hostSerialSetOutput(FILE *out);
+// Total number of bytes written to Serial
+unsigned long hostSerialBytesWritten(void);
+// What Serial.availableForWrite() reports (default 63, an empty Uno TX buffer)
+void hostSerialSetTxFree(int bytes);
+
+// FastPin backend (FastIO.h).  Same as digitalRead()/digitalWrite() but counted separately.
+int hostFastRead(uint8_t pin);
+void hostFastWrite(uint8_t pin, uint8_t val);
+// FastPort backend: the levels of the pins firstPin + bit for the bits set in mask
+uint8_t hostFastReadPort(uint8_t firstPin, uint8_t mask);
+// Number of digitalRead()/digitalWrite() calls and FastPin reads/writes so far
+unsigned long hostGetCoreIoCount(void);
+unsigned long hostGetFastIoCount(void);
+
+#endif // HALHOST_H
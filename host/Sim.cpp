@@ -0,0 +1,203 @@
+// Simple plant model for running elegoo_robot on the host
+#include "Sim.h"
+#include "HalHost.h"
+#include "RobotMap.h"
+
+#define SPEED_OF_SOUND_MM_PER_US 0.343
+
+static uint8_t s_gameState;
+static int8_t s_lx, s_ly, s_rx, s_ry;
+static uint8_t s_lTrig, s_rTrig;
+static uint16_t s_buttons;
+static unsigned long s_lastPacketMs;
+static unsigned long s_lastStepUs;
+
+static double s_elevatorMm;
+static double s_leftMm, s_rightMm;
+static double s_leftEdgeMm, s_rightEdgeMm;
+
+static int s_obstacleMm;
+static unsigned long s_lastTrigCount;
+static bool s_echoPending;
+static unsigned long s_echoRiseUs, s_echoFallUs;
+
+
+////////////////////////////////////////////////////////////////////
+// Queue a DriverStation packet (same layout as DriverStation::GameData)
+static void sendPacket() {
+  uint8_t pkt[16];
+  pkt[0] = 0xA5;
+  pkt[1] = 1;
+  pkt[2] = sizeof(pkt);
+  pkt[3] = s_gameState;
+  pkt[4] = s_buttons & 0xff;
+  pkt[5] = s_buttons >> 8;
+  pkt[6] = s_lTrig;
+  pkt[7] = s_rTrig;
+  pkt[8] = (uint8_t)s_lx;
+  pkt[9] = (uint8_t)s_ly;
+  pkt[10] = (uint8_t)s_rx;
+  pkt[11] = (uint8_t)s_ry;
+  pkt[12] = 0;
+  pkt[13] = 0;
+  uint16_t sum = 0;
+  for(int i = 0; i < 14; i++) {
+    sum += pkt[i];
+  }
+  pkt[14] = sum & 0xff;
+  pkt[15] = sum >> 8;
+  hostSerialInject(pkt, sizeof(pkt));
+}
+
+////////////////////////////////////////////////////////////////////
+// Signed speed (mm/s) of one drive side from its L298 pins
+static double sideSpeed(uint8_t enPin, uint8_t in1Pin, uint8_t in2Pin) {
+  int pwm = hostGetPwm(enPin);
+  if(pwm <= SIM_DRIVE_DEADBAND) {
+    return 0;
+  }
+  double speed = (pwm - SIM_DRIVE_DEADBAND) * (double)SIM_DRIVE_MM_PER_SEC / (255 - SIM_DRIVE_DEADBAND);
+  if(hostGetPin(in1Pin) && !hostGetPin(in2Pin)) {
+    return speed;
+  }
+  if(!hostGetPin(in1Pin) && hostGetPin(in2Pin)) {
+    return -speed;
+  }
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////
+// Move one side and toggle its encoder pin for every edge passed.  Each edge is delivered with
+// the time it would have happened at during the step (constant speed across the step).
+static void moveSide(double deltaMm, unsigned long stepStartUs, unsigned long stepUs,
+                     double *pTravelMm, double *pEdgeMm, uint8_t encoderPin) {
+  double absMm = (deltaMm < 0) ? -deltaMm : deltaMm;
+  double edgeAtMm = SIM_ENCODER_MM_PER_EDGE - *pEdgeMm;  // How far into this step the next edge is
+  *pTravelMm += deltaMm;
+  while(edgeAtMm <= absMm) {
+    hostSetPinAt(encoderPin, !hostGetPin(encoderPin), stepStartUs + (unsigned long)(edgeAtMm / absMm * stepUs));
+    edgeAtMm += SIM_ENCODER_MM_PER_EDGE;
+  }
+  *pEdgeMm = SIM_ENCODER_MM_PER_EDGE - (edgeAtMm - absMm);
+}
+
+
+void simInit(uint8_t gameState) {
+  s_gameState = gameState;
+  s_lx = s_ly = s_rx = s_ry = 0;
+  s_lTrig = s_rTrig = 0;
+  s_buttons = 0;
+  s_lastPacketMs = millis();
+  s_lastStepUs = micros();
+  s_elevatorMm = 0;
+  s_leftMm = s_rightMm = 0;
+  s_leftEdgeMm = s_rightEdgeMm = 0;
+  s_lastTrigCount = hostGetPinRiseCount(ULTRASONIC_TRIG);
+  s_echoPending = false;
+
+  hostSetPin(LEFT_WHEEL_ENCODER_PIN, LOW);
+  hostSetPin(RIGHT_WHEEL_ENCODER_PIN, LOW);
+  hostSetPin(ULTRASONIC_ECHO, LOW);
+  simSetLineSensors(false, false, false);
+  simSetObstacleMm(1000);
+  sendPacket();
+}
+
+void simStep(void) {
+  unsigned long nowUs = micros();
+  unsigned long stepStartUs = s_lastStepUs;
+  unsigned long stepUs = (uint32_t)(nowUs - s_lastStepUs);
+  double dt = stepUs / 1e6;
+  s_lastStepUs = nowUs;
+
+  // DriverStation link
+  if((unsigned long)(millis() - s_lastPacketMs) >= SIM_DS_PERIOD_MS) {
+    s_lastPacketMs += SIM_DS_PERIOD_MS;
+    sendPacket();
+  }
+
+  // Elevator (continuous servo: 90 is stopped, 0 is full speed up, 180 is full speed down)
+  int angle = hostGetServo(ELEVATOR_SERVO_PIN);
+  if(angle >= 0) {
+    s_elevatorMm += (90 - angle) / 90.0 * SIM_ELEVATOR_MM_PER_SEC * dt;
+  }
+  if(s_elevatorMm <= 0) {
+    s_elevatorMm = 0;
+  }
+  else if(s_elevatorMm >= SIM_ELEVATOR_STROKE_MM) {
+    s_elevatorMm = SIM_ELEVATOR_STROKE_MM;
+  }
+  hostSetPin(ELEVATOR_LOWER_LIMIT_SWITCH_PIN, s_elevatorMm <= 0);
+  hostSetPin(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, s_elevatorMm >= SIM_ELEVATOR_STROKE_MM);
+
+  // Ultrasonic.  The sensor ignores triggers while a ping is in flight.
+  unsigned long trigCount = hostGetPinRiseCount(ULTRASONIC_TRIG);
+  if(trigCount != s_lastTrigCount) {
+    s_lastTrigCount = trigCount;
+    if(!s_echoPending) {
+      s_echoPending = true;
+      s_echoRiseUs = nowUs + SIM_ECHO_DELAY_US;
+      s_echoFallUs = s_echoRiseUs + ((s_obstacleMm > 0) ? (unsigned long)(s_obstacleMm * 2 / SPEED_OF_SOUND_MM_PER_US) : SIM_ECHO_NONE_US);
+    }
+  }
+  if(s_echoPending) {
+    if((int32_t)(nowUs - s_echoFallUs) >= 0) {
+      hostSetPin(ULTRASONIC_ECHO, HIGH);  // In case the step skipped the whole pulse
+      hostSetPin(ULTRASONIC_ECHO, LOW);
+      s_echoPending = false;
+    }
+    else if((int32_t)(nowUs - s_echoRiseUs) >= 0) {
+      hostSetPin(ULTRASONIC_ECHO, HIGH);
+    }
+  }
+
+  // Drivetrain (the right side is wired ENB/IN4/IN3)
+  moveSide(sideSpeed(L298_ENA_PIN, L298_IN1_PIN, L298_IN2_PIN) * dt, stepStartUs, stepUs,
+           &s_leftMm, &s_leftEdgeMm, LEFT_WHEEL_ENCODER_PIN);
+  moveSide(sideSpeed(L298_ENB_PIN, L298_IN4_PIN, L298_IN3_PIN) * dt, stepStartUs, stepUs,
+           &s_rightMm, &s_rightEdgeMm, RIGHT_WHEEL_ENCODER_PIN);
+}
+
+void simSetGameState(uint8_t gameState) {
+  s_gameState = gameState;
+}
+
+void simSetSticks(int8_t lx, int8_t ly, int8_t rx, int8_t ry) {
+  s_lx = lx;
+  s_ly = ly;
+  s_rx = rx;
+  s_ry = ry;
+}
+
+void simSetTriggers(uint8_t lTrig, uint8_t rTrig) {
+  s_lTrig = lTrig;
+  s_rTrig = rTrig;
+}
+
+void simSetButtons(uint16_t buttons) {
+  s_buttons = buttons;
+}
+
+void simSetObstacleMm(int distanceMm) {
+  s_obstacleMm = distanceMm;
+  hostSetPulseWidth(ULTRASONIC_ECHO, (distanceMm > 0) ? (unsigned long)(distanceMm * 2 / SPEED_OF_SOUND_MM_PER_US) : 0);
+}
+
+void simSetLineSensors(bool leftBlack, bool middleBlack, bool rightBlack) {
+  // Sensors read 0 over a black line
+  hostSetPin(LINE_LEFT_PIN, !leftBlack);
+  hostSetPin(LINE_MIDDLE_PIN, !middleBlack);
+  hostSetPin(LINE_RIGHT_PIN, !rightBlack);
+}
+
+long simGetLeftTravelMm(void) {
+  return (long)s_leftMm;
+}
+
+long simGetRightTravelMm(void) {
+  return (long)s_rightMm;
+}
+
+int simGetElevatorMm(void) {
+  return (int)s_elevatorMm;
+}
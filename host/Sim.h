@@ -0,0 +1,38 @@
+// Simple plant model for running elegoo_robot on the host
+// Drives the host HAL's inputs from its outputs so the sketch sees a plausible robot:
+// - A DriverStation packet every 100ms with the configured game state, sticks and buttons
+// - An elevator that moves with the continuous servo and trips the limit switches at the ends
+// - Wheels that move with the L298 outputs and toggle the wheel encoder pins
+// - An ultrasonic echo for an object at a fixed distance (pulseIn, or ECHO edges after a trigger)
+// - Line sensors that read white unless told otherwise
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+// Plant constants (rough numbers for the competition robot)
+#define SIM_ELEVATOR_STROKE_MM        120
+#define SIM_ELEVATOR_MM_PER_SEC       60    // At full servo speed
+#define SIM_DRIVE_MM_PER_SEC          400   // At full power (255)
+#define SIM_DRIVE_DEADBAND            40    // Power below this doesn't turn the wheels
+#define SIM_ENCODER_MM_PER_EDGE       (905 / 178.0)
+#define SIM_DS_PERIOD_MS              100
+#define SIM_ECHO_DELAY_US             450   // Trigger to ECHO going high
+#define SIM_ECHO_NONE_US              38000 // ECHO pulse when nothing is heard (HC-SR04)
+
+void simInit(uint8_t gameState);
+void simStep(void);
+
+void simSetGameState(uint8_t gameState);
+void simSetSticks(int8_t lx, int8_t ly, int8_t rx, int8_t ry);
+void simSetTriggers(uint8_t lTrig, uint8_t rTrig);
+void simSetButtons(uint16_t buttons);
+void simSetObstacleMm(int distanceMm);  // <= 0 means no echo
+void simSetLineSensors(bool leftBlack, bool middleBlack, bool rightBlack);
+
+// Plant state
+long simGetLeftTravelMm(void);
+long simGetRightTravelMm(void);
+int simGetElevatorMm(void);
+
+#endif // SIM_H
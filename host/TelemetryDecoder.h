@@ -0,0 +1,154 @@
+// Host side of Telemetry.h and EventLog.h: picks telemetry packets and log records out of a
+// Serial capture and prints them as CSV / text.  Used by telemetry_decode and the tests.
+#ifndef TELEMETRYDECODER_H
+#define TELEMETRYDECODER_H
+
+#include <stdio.h>
+#include <string.h>
+#include "Telemetry.h"
+#include "EventLog.h"
+
+// What TelemetryDecoder::feed() found
+enum DecodedTypes {
+  decodedNone = 0,
+  decodedTelemetry,
+  decodedLog
+};
+
+class TelemetryDecoder {
+private:
+  uint8_t m_buff[sizeof(TelemetryData)];   // Big enough for either frame
+  unsigned int m_rcvd;
+  unsigned long m_packets;
+  unsigned long m_records;
+  unsigned long m_bad;        // Frames with a good header but a bad checksum
+  unsigned long m_missed;     // Packets skipped by the robot (gaps in the sequence)
+  int m_lastSeq;
+  unsigned long m_logTimeMs;  // Log record time, unwrapped from 16 bits
+
+  // Size of the frame being received (0 if the first byte isn't a preamble)
+  unsigned int frameSize() {
+    switch(m_buff[0]) {
+    case TELEMETRY_PREAMBLE:
+      return sizeof(TelemetryData);
+    case LOG_PREAMBLE:
+      return sizeof(LogRecord);
+    }
+    return 0;
+  }
+
+  // True if the bytes received so far can be the start of a frame
+  bool headerOk() {
+    if(m_buff[0] == TELEMETRY_PREAMBLE) {
+      return (m_rcvd < 2 || m_buff[1] == TELEMETRY_VERSION) &&
+             (m_rcvd < 3 || m_buff[2] == sizeof(TelemetryData));
+    }
+    if(m_buff[0] == LOG_PREAMBLE) {
+      return m_rcvd < 2 || m_buff[1] < NUM_LOG_EVENTS;
+    }
+    return false;
+  }
+
+  // Drop the first byte and look for the next preamble in what's left
+  void resync() {
+    do {
+      unsigned int skip = 1;
+      while(skip < m_rcvd && m_buff[skip] != TELEMETRY_PREAMBLE && m_buff[skip] != LOG_PREAMBLE) {
+        skip++;
+      }
+      m_rcvd -= skip;
+      memmove(m_buff, m_buff + skip, m_rcvd);
+    } while(m_rcvd && !headerOk());
+  }
+
+public:
+  TelemetryDecoder() : m_rcvd(0), m_packets(0), m_records(0), m_bad(0), m_missed(0),
+                       m_lastSeq(-1), m_logTimeMs(0) {}
+
+  // Feed one byte.  When it completes a frame, fills in *pData or *pRecord and says which.
+  DecodedTypes feed(uint8_t c, TelemetryData *pData, LogRecord *pRecord) {
+    m_buff[m_rcvd++] = c;
+    if(!headerOk()) {
+      resync();
+      return decodedNone;
+    }
+    unsigned int size = frameSize();
+    if(m_rcvd < size) {
+      return decodedNone;
+    }
+
+    uint16_t sum = 0;
+    for(unsigned int i = 0; i < size - 2; i++) {
+      sum += m_buff[i];
+    }
+    if(sum != (m_buff[size - 2] | (m_buff[size - 1] << 8))) {
+      m_bad++;
+      resync();
+      return decodedNone;
+    }
+    m_rcvd = 0;
+
+    if(m_buff[0] == LOG_PREAMBLE) {
+      memcpy(pRecord, m_buff, sizeof(LogRecord));
+      m_records++;
+      // Records are never a minute apart, so the time only moves forward
+      m_logTimeMs += (uint16_t)(pRecord->u16TimeMs - (uint16_t)m_logTimeMs);
+      return decodedLog;
+    }
+
+    memcpy(pData, m_buff, sizeof(TelemetryData));
+    m_packets++;
+    if(m_lastSeq >= 0) {
+      m_missed += (uint8_t)(pData->u8Seq - m_lastSeq - 1);
+    }
+    m_lastSeq = pData->u8Seq;
+    return decodedTelemetry;
+  }
+
+  unsigned long getPackets() { return m_packets; }
+  unsigned long getRecords() { return m_records; }
+  unsigned long getBad() { return m_bad; }
+  unsigned long getMissed() { return m_missed; }
+
+  // Time of the last log record (ms, unwrapped)
+  unsigned long getLogTimeMs() { return m_logTimeMs; }
+
+  static void printHeader(FILE *out) {
+    fprintf(out, "seq,time_ms,loops,max_loop_us,left_ticks,right_ticks,x_mm,y_mm,heading_deg,"
+                 "left_power,right_power,elevator_power,ultrasonic_mm,cmd_step,busy,"
+                 "elevator_lower,elevator_upper,line_left,line_middle,line_right,gripper_open,"
+                 "link_errors\n");
+  }
+
+  static void printCsv(FILE *out, const TelemetryData &d) {
+    fprintf(out, "%u,%lu,%u,%u,%d,%d,%d,%d,%.1f,%d,%d,%d,%d,%d,%u,%d,%d,%d,%d,%d,%d,%u\n",
+            d.u8Seq, (unsigned long)d.u32TimeMs, d.u16Loops, d.u16MaxLoopUs,
+            d.i16LeftTicks, d.i16RightTicks, d.i16XMm, d.i16YMm, d.u16Heading * 360.0 / 65536,
+            d.i16LeftPower, d.i16RightPower, d.i16ElevatorPower, d.i16UltrasonicMm,
+            d.i8CmdStep, d.u8Busy,
+            (d.u8Flags & TELEM_ELEVATOR_LOWER) != 0, (d.u8Flags & TELEM_ELEVATOR_UPPER) != 0,
+            (d.u8Flags & TELEM_LINE_LEFT) != 0, (d.u8Flags & TELEM_LINE_MIDDLE) != 0,
+            (d.u8Flags & TELEM_LINE_RIGHT) != 0, (d.u8Flags & TELEM_GRIPPER_OPEN) != 0,
+            d.u8LinkErrors);
+  }
+
+  // One line per log record: time, event and its data
+  void printLog(FILE *out, const LogRecord &r) {
+    static const char * const s_events[NUM_LOG_EVENTS] = {
+      "trace line=%d value=%d",
+      "dropped %d record(s)",
+      "straight done ticks=%d target=%d left=%d right=%d",
+      "rotate start deg=%d mm=%d",
+      "rotate done deg=%d target=%d left=%d right=%d",
+      "ultrasonic mm=%d",
+      "cup scan centre=%d end=%d ticks angle=%d mm=%d",
+      "cup at x=%d y=%d",
+      "no free command slot",
+    };
+    fprintf(out, "%8.3f ", getLogTimeMs() / 1000.0);
+    fprintf(out, s_events[r.u8Event], r.i16Data[0], r.i16Data[1], r.i16Data[2], r.i16Data[3]);
+    fprintf(out, "\n");
+  }
+};
+
+#endif // TELEMETRYDECODER_H
@@ -0,0 +1,38 @@
+// Shared by the host tests (test_*.cpp): failure counting, expect(), and the PASS (or failure
+// count) line and exit code each test ends with.  Each test is its own executable, so the
+// failure count is per test.
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <stdio.h>
+
+#define TEST_MAX_REPORTS  20    // Failures printed (the rest are only counted)
+
+static int s_failures = 0;
+
+////////////////////////////////////////////////////////////////////
+// Count a failure.  Returns true if it should be printed.
+inline bool testFailed() {
+  return s_failures++ < TEST_MAX_REPORTS;
+}
+
+////////////////////////////////////////////////////////////////////
+// Check a value
+inline void expect(const char *pName, long value, long expected) {
+  if(value != expected && testFailed()) {
+    printf("FAIL %s = %ld, expected %ld\n", pName, value, expected);
+  }
+}
+
+////////////////////////////////////////////////////////////////////
+// Print the result and return main()'s exit code
+inline int testResult() {
+  if(s_failures) {
+    printf("%d failure(s)\n", s_failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
+
+#endif // TESTUTIL_H
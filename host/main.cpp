@@ -0,0 +1,141 @@
+// Native Linux runner for elegoo_robot
+// Runs setup() and then loop() against the host HAL and the plant model, and reports how fast
+// loop() ran.
+//
+// Usage: elegoo_host [-n loops] [-m pre|auto|teleop|post] [-b buttons] [-o mm] [-q] [-p] [-v [-t loopUs]]
+//   -n  Number of loop() calls (default 100000)
+//   -m  Game state sent by the simulated DriverStation (default auto)
+//   -b  Controller buttons held down for the whole run (bit mask, e.g. 0x4000 for D-Left)
+//   -o  Distance to the object in front of the ultrasonic sensor (default 1000mm, 0 for none)
+//   -q  Discard the sketch's Serial output
+//   -p  Press PROFILE_DUMP_BTN at the end of the run to print the loop profile (needs a
+//       LOOP_PROFILER build).  Serial output is turned back on for the dump.
+//   -v  Virtual clock: time only advances by -t microseconds per loop (default 100) plus any
+//       blocking calls.  Runs are deterministic and independent of the host's speed.
+//
+// The summary at the end includes the digital I/O calls per loop and what they would cost on
+// the Uno.  Build with DEFINES="-DLOOP_PROFILER -DSLOW_IO" to compare against plain
+// digitalRead()/digitalWrite() (see FastIO.h).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "HalHost.h"
+#include "Sim.h"
+#include "DriverStation.h"
+#include "LoopProfiler.h"
+
+// Approximate cost of one digital I/O call on the Uno (16MHz): digitalRead()/digitalWrite()
+// with the call overhead and table lookups, and a FastPin IN/SBI/CBI
+#define UNO_CORE_IO_US  3.5
+#define UNO_FAST_IO_US  0.125
+
+// Sketch entry points (elegoo_robot.ino)
+void setup();
+void loop();
+
+static uint8_t parseGameState(const char *mode) {
+  if(strcmp(mode, "pre") == 0) return ePreGame;
+  if(strcmp(mode, "teleop") == 0) return eTeleop;
+  if(strcmp(mode, "post") == 0) return ePostGame;
+  return eAutonomous;
+}
+
+static double hostSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  long loops = 100000;
+  uint8_t gameState = eAutonomous;
+  uint16_t buttons = 0;
+  int obstacleMm = 1000;
+  bool quiet = false;
+  bool profileDump = false;
+  bool virtualClock = false;
+  unsigned long loopUs = 100;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      loops = atol(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      gameState = parseGameState(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      buttons = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      obstacleMm = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-q") == 0) {
+      quiet = true;
+    }
+    else if(strcmp(argv[i], "-p") == 0) {
+      profileDump = true;
+    }
+    else if(strcmp(argv[i], "-v") == 0) {
+      virtualClock = true;
+    }
+    else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      loopUs = strtoul(argv[++i], NULL, 10);
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-n loops] [-m pre|auto|teleop|post] [-b buttons] [-o mm] [-q] [-p] [-v [-t loopUs]]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  hostUseVirtualClock(virtualClock);
+  if(quiet) {
+    hostSerialSetOutput(NULL);
+  }
+
+  simInit(gameState);
+  simSetButtons(buttons);
+  simSetObstacleMm(obstacleMm);
+  setup();
+
+  unsigned long startCoreIo = hostGetCoreIoCount();
+  unsigned long startFastIo = hostGetFastIoCount();
+  unsigned long startUs = micros();
+  double startHost = hostSeconds();
+  for(long i = 0; i < loops; i++) {
+    if(virtualClock) {
+      hostAdvanceMicros(loopUs);
+    }
+    simStep();
+    loop();
+  }
+  double hostElapsed = hostSeconds() - startHost;
+  unsigned long robotElapsedUs = micros() - startUs;
+  double coreIoPerLoop = loops ? (double)(hostGetCoreIoCount() - startCoreIo) / loops : 0.0;
+  double fastIoPerLoop = loops ? (double)(hostGetFastIoCount() - startFastIo) / loops : 0.0;
+
+  if(profileDump) {
+    // Hold the dump button until the sketch has seen it in a DriverStation packet
+    hostSerialSetOutput(stdout);
+    simSetButtons(buttons | (1 << PROFILE_DUMP_BTN));
+    unsigned long pressMs = millis();
+    while((unsigned long)(millis() - pressMs) < 2 * SIM_DS_PERIOD_MS) {
+      if(virtualClock) {
+        hostAdvanceMicros(loopUs);
+      }
+      simStep();
+      loop();
+    }
+  }
+
+  fflush(stdout);
+  fprintf(stderr, "\n%ld loops, robot time %lu us (%.2f us/loop), host time %.3f s (%.0f loops/s)\n",
+          loops, robotElapsedUs, loops ? (double)robotElapsedUs / loops : 0.0,
+          hostElapsed, hostElapsed > 0 ? loops / hostElapsed : 0.0);
+  fprintf(stderr, "Digital I/O per loop: %.2f digitalRead/Write, %.2f FastPin (~%.1f us on the Uno)\n",
+          coreIoPerLoop, fastIoPerLoop, coreIoPerLoop * UNO_CORE_IO_US + fastIoPerLoop * UNO_FAST_IO_US);
+  fprintf(stderr, "Plant: left %ld mm, right %ld mm, elevator %d mm\n",
+          simGetLeftTravelMm(), simGetRightTravelMm(), simGetElevatorMm());
+  return 0;
+}
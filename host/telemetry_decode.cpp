@@ -0,0 +1,61 @@
+// Decode a Serial capture from the robot
+//
+//   telemetry_decode [-l] [capture] > telemetry.csv
+//
+// Reads the raw Serial stream from the file (or stdin) and prints the telemetry packets (see
+// ../elegoo_robot/Telemetry.h) as CSV, or with -l the event log records (EventLog.h) as text.
+// Text the sketch prints in between is skipped.  A summary goes to stderr.  For example, from
+// the simulator:
+//
+//   ./build/elegoo_host -v -n 150000 | ./build/telemetry_decode -l
+//   make clean all DEFINES="-DTELEMETRY"
+//   ./build/elegoo_host -v -n 150000 | ./build/telemetry_decode > auto.csv
+#include <stdio.h>
+#include <string.h>
+#include "HalHost.h"
+#include "TelemetryDecoder.h"
+
+int main(int argc, char **argv) {
+  bool printLog = false;
+  FILE *in = stdin;
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-l") == 0) {
+      printLog = true;
+    }
+    else {
+      in = fopen(argv[i], "rb");
+      if(!in) {
+        perror(argv[i]);
+        return 1;
+      }
+    }
+  }
+
+  TelemetryDecoder decoder;
+  TelemetryData data;
+  LogRecord record;
+  if(!printLog) {
+    TelemetryDecoder::printHeader(stdout);
+  }
+  int c;
+  while((c = fgetc(in)) != EOF) {
+    switch(decoder.feed((uint8_t)c, &data, &record)) {
+    case decodedTelemetry:
+      if(!printLog) {
+        TelemetryDecoder::printCsv(stdout, data);
+      }
+      break;
+    case decodedLog:
+      if(printLog) {
+        decoder.printLog(stdout, record);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  fprintf(stderr, "%lu packets, %lu missed by the robot, %lu log records, %lu bad\n",
+          decoder.getPackets(), decoder.getMissed(), decoder.getRecords(), decoder.getBad());
+  return 0;
+}
@@ -0,0 +1,78 @@
+// CommandScheduler with every slot in use: a group member that can't start when the step
+// before it finishes cancels the whole top-level command, not just its own group, so no group
+// is left waiting in a slot (and holding its subsystems) forever.
+#include <stdio.h>
+#include "CommandScheduler.h"
+#include "TestUtil.h"
+
+static int s_finishNow = 0;     // Steps of "step" to finish on the next run()
+static int s_cancelled = 0;     // Cleanups of cancelled (still running) commands
+
+// Finishes when told to
+static void handleStep(Command &cmd) {
+  if(cmd.isRunning) {
+    if(s_finishNow) {
+      s_finishNow--;
+      cmd.isRunning = false;
+    }
+  }
+  else {
+    s_cancelled++;
+  }
+}
+
+// Never finishes (holds a slot)
+static void handleHold(Command &cmd) {
+}
+
+const CommandDef cmdStep PROGMEM = { handleStep, REQ_DRIVETRAIN, cmdSingle, NULL, 0 };
+const CommandDef cmdHold PROGMEM = { handleHold, REQ_NONE, cmdSingle, NULL, 0 };
+
+// inner = step, then (step) as a group of its own, so the second step needs two slots
+const CommandStep wrapSteps[] PROGMEM = { { &cmdStep, 0 } };
+const CommandDef cmdWrap PROGMEM = { NULL, 0, cmdSequential, wrapSteps, 1 };
+const CommandStep innerSteps[] PROGMEM = { { &cmdStep, 0 }, { &cmdWrap, 0 } };
+const CommandDef cmdInner PROGMEM = { NULL, 0, cmdSequential, innerSteps, 2 };
+// outer = inner (so the group that fails to start a member isn't the top-level one)
+const CommandStep outerSteps[] PROGMEM = { { &cmdInner, 0 } };
+const CommandDef cmdOuter PROGMEM = { NULL, 0, cmdSequential, outerSteps, 1 };
+
+int main() {
+  CommandScheduler scheduler;
+  scheduler.init();
+
+  // outer, inner and the first step take 3 slots, hold commands fill the rest
+  expect("outer started", scheduler.schedule(&cmdOuter), 1);
+  int holds = 0;
+  while(scheduler.schedule(&cmdHold)) {
+    holds++;
+  }
+  expect("hold commands", holds, MAX_COMMANDS - 3);
+  expect("drivetrain busy", scheduler.getBusySubsystems(), REQ_DRIVETRAIN);
+
+  // First step finishes: wrap gets its slot but its step can't start
+  s_finishNow = 1;
+  scheduler.run();
+  expect("outer cancelled", scheduler.isScheduled(&cmdOuter), 0);
+  expect("nothing left busy", scheduler.getBusySubsystems(), REQ_NONE);
+
+  // Only the hold commands are left: all three of the group's slots are free again
+  int freed = 0;
+  while(scheduler.schedule(&cmdHold)) {
+    freed++;
+  }
+  expect("no orphaned group", freed, 3);
+  scheduler.cancelAll();
+
+  // With room to spare the same command runs to the end
+  s_cancelled = 0;
+  expect("outer restarted", scheduler.schedule(&cmdOuter), 1);
+  for(int i = 0; i < 4; i++) {
+    s_finishNow = 1;
+    scheduler.run();
+  }
+  expect("outer done", scheduler.isRunning(), 0);
+  expect("nothing cancelled", s_cancelled, 0);
+
+  return testResult();
+}
@@ -0,0 +1,90 @@
+// CupDetector: finds the first cup in a scan one reading at a time, centred on the encoder ticks
+// the readings were taken at (so an uneven turn speed doesn't move it), keeps the closest
+// reading, restarts on a closer cup and ignores no-echo readings.  Also the ticks to degrees
+// conversion the scan uses to turn back.
+#include <stdio.h>
+#include "Drivetrain.h"
+#include "CupDetector.h"
+#include "UltrasonicSensor.h"
+#include "TestUtil.h"
+
+struct Reading {
+  int distanceMm;
+  int ticks;
+};
+
+// Feed readings until the cup is found.  Returns how many were used.
+static int feed(CupDetector &detector, const Reading *pReadings, int count) {
+  for(int i = 0; i < count; i++) {
+    if(detector.addReading(pReadings[i].distanceMm, pReadings[i].ticks)) {
+      return i + 1;
+    }
+  }
+  return count;
+}
+
+int main() {
+  CupDetector detector;
+
+  // Cup from tick 10 to 30, with the robot turning slowly over the first half (many readings)
+  // and fast over the second (few).  A by-reading centre would land at tick ~15.
+  static const Reading uneven[] = {
+    { 900, 0 }, { 800, 5 }, { 250, 10 }, { 240, 11 }, { 235, 12 }, { 232, 13 }, { 230, 14 },
+    { 231, 15 }, { 233, 16 }, { 236, 17 }, { 238, 18 }, { 240, 19 }, { 245, 20 }, { 250, 30 },
+    { 700, 34 }, { 150, 40 }, { 700, 44 }
+  };
+  detector.reset(300);
+  int used = feed(detector, uneven, sizeof(uneven) / sizeof(uneven[0]));
+  expect("stops at the far edge", used, 15);
+  expect("found", detector.isFound(), 1);
+  expect("centre ticks", detector.getCentreTicks(100), 20);
+  expect("closest", detector.getDistanceMm(), 230);
+  // Later readings don't change anything (the second cup is ignored)
+  detector.addReading(150, 40);
+  expect("centre after found", detector.getCentreTicks(100), 20);
+
+  // No-echo readings are ignored, beyond range ends the cup
+  static const Reading noEcho[] = {
+    { ULTRASONIC_BEYOND_RANGE, 0 }, { 200, 4 }, { -1, 6 }, { 210, 8 }, { -1, 10 },
+    { ULTRASONIC_BEYOND_RANGE, 12 }
+  };
+  detector.reset(300);
+  used = feed(detector, noEcho, sizeof(noEcho) / sizeof(noEcho[0]));
+  expect("beyond range ends it", used, 6);
+  expect("centre (no echo ignored)", detector.getCentreTicks(100), 6);
+
+  // A closer cup in front restarts the cup
+  static const Reading closer[] = {
+    { 280, 0 }, { 275, 2 }, { 150, 4 }, { 155, 6 }, { 152, 8 }, { 290, 10 }
+  };
+  detector.reset(300);
+  used = feed(detector, closer, sizeof(closer) / sizeof(closer[0]));
+  expect("closer cup found", detector.isFound(), 1);
+  expect("closer cup centre", detector.getCentreTicks(100), 6);
+  expect("closer cup distance", detector.getDistanceMm(), 150);
+
+  // Scan ends on the cup: the far edge is where the scan ended
+  detector.reset(300);
+  detector.addReading(500, 0);
+  detector.addReading(200, 20);
+  detector.addReading(205, 24);
+  expect("not found", detector.isFound(), 0);
+  expect("has cup", detector.hasCup(), 1);
+  expect("centre to the scan end", detector.getCentreTicks(40), 30);
+
+  // Nothing in range
+  detector.reset(300);
+  detector.addReading(500, 0);
+  detector.addReading(-1, 10);
+  expect("no cup", detector.hasCup(), 0);
+  expect("readings", detector.getReadings(), 2);
+
+  // Ticks to degrees is the inverse of the rotate distance (both sides' ticks added)
+  int ticks = (int)(Drivetrain::rotateDegToMm(90) * TICKS_PER_MM * 2 + 0.5);
+  int deg = Drivetrain::rotateTicksToDeg(ticks);
+  printf("90 deg turn = %d ticks (both sides), back to %d deg\n", ticks, deg);
+  expect("ticks to deg", deg >= 85 && deg <= 95, 1);
+  expect("0 ticks", Drivetrain::rotateTicksToDeg(0), 0);
+
+  return testResult();
+}
@@ -0,0 +1,72 @@
+// Encoder direction across a stop: the wheels keep turning the way they were driven for a while
+// after setPower(0, 0) or a zero velocity target, so those coast ticks have to count the same
+// way.  Odometry mustn't move backwards or turn the wrong way when the robot stops.
+#include <stdio.h>
+#include "Drivetrain.h"
+#include "TestUtil.h"
+
+// Edges on each encoder pin (the ISRs count them), spaced past the glitch filter
+static void wheelEdges(int leftEdges, int rightEdges) {
+  for(int i = 0; i < leftEdges || i < rightEdges; i++) {
+    hostAdvanceMicros(5000);
+    if(i < leftEdges) {
+      hostSetPin(LEFT_WHEEL_ENCODER_PIN, !hostGetPin(LEFT_WHEEL_ENCODER_PIN));
+    }
+    if(i < rightEdges) {
+      hostSetPin(RIGHT_WHEEL_ENCODER_PIN, !hostGetPin(RIGHT_WHEEL_ENCODER_PIN));
+    }
+  }
+}
+
+int main() {
+  hostUseVirtualClock(true);
+  Drivetrain drivetrain;
+  drivetrain.init();
+  Odometry &odometry = drivetrain.getOdometry();
+
+  // Drive forward, stop and coast on: all the ticks count forward
+  drivetrain.setPower(200, 200);
+  wheelEdges(20, 20);
+  drivetrain.setPower(0, 0);
+  wheelEdges(6, 6);
+  drivetrain.update();
+  expect("left ticks after coasting", drivetrain.getLeftTicks(), 26);
+  expect("right ticks after coasting", drivetrain.getRightTicks(), 26);
+  long xMm = odometry.getXMm();
+  expect("moved forward", xMm > 0, 1);
+  expect("heading unchanged", odometry.getHeading(), 0);
+
+  // Reverse counts down again
+  drivetrain.setPower(-200, -200);
+  wheelEdges(10, 10);
+  drivetrain.setPower(0, 0);
+  wheelEdges(2, 2);
+  expect("left ticks after reversing", drivetrain.getLeftTicks(), 14);
+
+  // Same through the velocity controllers
+  drivetrain.setVelocity(200, 200);
+  wheelEdges(4, 4);
+  drivetrain.setVelocity(0, 0);
+  wheelEdges(3, 3);
+  expect("left ticks after a zero velocity", drivetrain.getLeftTicks(), 21);
+  expect("right ticks after a zero velocity", drivetrain.getRightTicks(), 21);
+
+  // A scan turn stopped early (abortAuto()) coasts on in the same direction, and
+  // getRotateTicks() has to include that for the turn back to the cup
+  drivetrain.autoRotate(90);
+  for(int i = 0; i < 12; i++) {
+    wheelEdges(1, 1);
+    drivetrain.update();
+    drivetrain.updateAuto();
+  }
+  int scanTicks = drivetrain.getRotateTicks();
+  expect("ticks into the turn", scanTicks, 24);
+  drivetrain.abortAuto();
+  wheelEdges(5, 5);
+  drivetrain.update();
+  expect("turn ticks after coasting", drivetrain.getRotateTicks(), scanTicks + 10);
+  expect("left still forward", drivetrain.getLeftTicks(), 17);
+  expect("right still reverse", drivetrain.getRightTicks(), -17);
+
+  return testResult();
+}
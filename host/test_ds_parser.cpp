@@ -0,0 +1,224 @@
+// DriverStation packet parser: fuzz test and throughput benchmark
+// - Fuzz: good packets mixed with noise, bit flips and cut-off packets.  The parser has to
+//   find every valid packet in the stream, including the ones right after damaged data.
+// - Throughput: bytes/s through bUpdate() on the host, and the most bytes taken in one call.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "DriverStation.h"
+#include "TestUtil.h"
+
+#define PACKET_SIZE       16
+#define FUZZ_PACKETS      50000   // Sequence numbers must not wrap
+#define BENCH_PACKETS     2000000
+
+////////////////////////////////////////////////////////////////////
+// Build a packet (same layout as DriverStation::GameData).  The sequence number goes in the
+// triggers so each decoded packet can be matched up with the one sent.
+static void makePacket(uint8_t *pkt, uint16_t seq) {
+  pkt[0] = DS_PREAMBLE;
+  pkt[1] = DS_VERSION;
+  pkt[2] = PACKET_SIZE;
+  pkt[3] = eTeleop;
+  pkt[4] = 0;
+  pkt[5] = 0;
+  pkt[6] = seq & 0xff;
+  pkt[7] = seq >> 8;
+  for(int i = 8; i < 14; i++) {
+    pkt[i] = 0;
+  }
+  uint16_t sum = 0;
+  for(int i = 0; i < 14; i++) {
+    sum += pkt[i];
+  }
+  pkt[14] = sum & 0xff;
+  pkt[15] = sum >> 8;
+}
+
+////////////////////////////////////////////////////////////////////
+// Reference parser: scan the whole stream and take every 16 bytes that form a valid packet,
+// starting again after it.  A plain byte sum can be fooled (a cut-off packet followed by the
+// next header sometimes adds up), so this is what bUpdate() has to match, rather than the
+// list of packets sent.
+static long referenceParse(const uint8_t *pStream, unsigned long len, uint16_t *pSeqs) {
+  long found = 0;
+  unsigned long i = 0;
+  while(i + PACKET_SIZE <= len) {
+    const uint8_t *pkt = pStream + i;
+    uint16_t sum = 0;
+    for(int n = 0; n < 14; n++) {
+      sum += pkt[n];
+    }
+    if(pkt[0] == DS_PREAMBLE && pkt[1] == DS_VERSION && pkt[2] == PACKET_SIZE &&
+       sum == (pkt[14] | (pkt[15] << 8))) {
+      pSeqs[found++] = pkt[6] | (pkt[7] << 8);
+      i += PACKET_SIZE;
+    }
+    else {
+      i++;
+    }
+  }
+  return found;
+}
+
+////////////////////////////////////////////////////////////////////
+// Good packets with damage in between, delivered in random sized chunks.  Damaged packets
+// have to be dropped and the packet after them still decoded.
+static void fuzz() {
+  static uint8_t s_stream[FUZZ_PACKETS * (PACKET_SIZE + 40)];
+  static uint16_t s_intact[FUZZ_PACKETS];
+  static uint16_t s_reference[FUZZ_PACKETS * 2];
+  static uint16_t s_decoded[FUZZ_PACKETS * 2];
+  unsigned long len = 0;
+  long numIntact = 0;
+  srand(1);
+
+  // Build the stream
+  for(long i = 0; i < FUZZ_PACKETS; i++) {
+    uint8_t pkt[PACKET_SIZE];
+    uint16_t seq = i & 0xffff;
+    makePacket(pkt, seq);
+
+    int pktLen = PACKET_SIZE;
+    switch(rand() % 8) {
+    case 0:
+      // Noise in front of the packet (often with preambles in it)
+      for(int n = rand() % 40; n > 0; n--) {
+        s_stream[len++] = (rand() % 4 == 0) ? DS_PREAMBLE : rand() & 0xff;
+      }
+      s_intact[numIntact++] = seq;
+      break;
+    case 1:
+      // Flip a bit
+      pkt[rand() % PACKET_SIZE] ^= 1 << (rand() % 8);
+      break;
+    case 2:
+      // Cut off part way through
+      pktLen = 1 + rand() % (PACKET_SIZE - 1);
+      break;
+    default:
+      s_intact[numIntact++] = seq;
+      break;
+    }
+    for(int n = 0; n < pktLen; n++) {
+      s_stream[len++] = pkt[n];
+    }
+  }
+  long numReference = referenceParse(s_stream, len, s_reference);
+
+  // Feed it through the parser
+  DriverStation ds;
+  long numDecoded = 0;
+  unsigned long calls = 0;
+  unsigned long sent = 0;
+  while(sent < len || Serial.available()) {
+    if(sent < len) {
+      unsigned long chunk = 1 + rand() % 64;
+      if(chunk > len - sent) {
+        chunk = len - sent;
+      }
+      hostSerialInject(s_stream + sent, chunk);
+      sent += chunk;
+    }
+    calls++;
+    if(ds.bUpdate()) {
+      s_decoded[numDecoded++] = ds.getLTrig() | (ds.getRTrig() << 8);
+    }
+  }
+
+  // Compare with the reference, and count the intact packets that made it
+  long mismatches = 0;
+  for(long i = 0; i < numReference && i < numDecoded; i++) {
+    if(s_decoded[i] != s_reference[i]) {
+      if(mismatches++ < 10) {
+        printf("FAIL: packet %ld decoded as %u, reference gives %u\n", i, s_decoded[i], s_reference[i]);
+      }
+    }
+  }
+  long recovered = 0;
+  for(long i = 0, j = 0; i < numIntact && j < numDecoded; i++) {
+    while(j < numDecoded && s_decoded[j] != s_intact[i] && s_decoded[j] < s_intact[i]) {
+      j++;
+    }
+    if(j < numDecoded && s_decoded[j] == s_intact[i]) {
+      recovered++;
+      j++;
+    }
+  }
+
+  printf("fuzz: %lu bytes in %lu calls, %ld intact packets, %ld recovered, %ld false packet(s)\n",
+         len, calls, numIntact, recovered, numDecoded - recovered);
+  if(numDecoded != numReference || mismatches) {
+    printf("FAIL: %ld packets decoded, reference parser finds %ld (%ld mismatched)\n",
+           numDecoded, numReference, mismatches);
+    s_failures++;
+  }
+
+  // The status counters have to agree
+  const DsStatus &status = ds.getStatus();
+  printf("status: ok %lu, bad version %u, bad size %u, bad checksum %u\n",
+         (unsigned long)status.u32FramesOk, status.u16BadVersion, status.u16BadSize,
+         status.u16BadChecksum);
+  if(status.u32FramesOk != (uint32_t)numDecoded || !status.u16BadChecksum) {
+    printf("FAIL: status counters don't match\n");
+    s_failures++;
+  }
+}
+
+////////////////////////////////////////////////////////////////////
+// Clean stream throughput, and the per-call byte limit
+static void bench() {
+  DriverStation ds;
+  uint8_t pkt[PACKET_SIZE];
+  makePacket(pkt, 0);
+  long decoded = 0;
+  unsigned long calls = 0;
+  int maxBytesPerCall = 0;
+
+  // Queue a backlog of noise and packets and check how much each call takes from it
+  uint8_t noise[100] = { 0 };
+  hostSerialInject(noise, sizeof(noise));
+  for(int i = 0; i < 8; i++) {
+    hostSerialInject(pkt, sizeof(pkt));
+  }
+  while(Serial.available()) {
+    int before = Serial.available();
+    ds.bUpdate();
+    if(before - Serial.available() > maxBytesPerCall) {
+      maxBytesPerCall = before - Serial.available();
+    }
+  }
+
+  clock_t start = clock();
+  for(long i = 0; i < BENCH_PACKETS; i++) {
+    hostSerialInject(pkt, sizeof(pkt));
+    while(Serial.available()) {
+      calls++;
+      if(ds.bUpdate()) {
+        decoded++;
+      }
+    }
+  }
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("throughput: %ld packets in %lu calls, %.1f MB/s (host), max %d bytes per call\n",
+         decoded, calls, BENCH_PACKETS * PACKET_SIZE / seconds / 1e6, maxBytesPerCall);
+  if(decoded != BENCH_PACKETS) {
+    printf("FAIL: %ld of %d packets decoded\n", decoded, BENCH_PACKETS);
+    s_failures++;
+  }
+  if(maxBytesPerCall > DS_MAX_BYTES_PER_UPDATE) {
+    printf("FAIL: bUpdate() took %d bytes in one call\n", maxBytesPerCall);
+    s_failures++;
+  }
+}
+
+int main() {
+  // Keep the watchdog from masking the decoded values
+  hostUseVirtualClock(true);
+
+  fuzz();
+  bench();
+
+  return testResult();
+}
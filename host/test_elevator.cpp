@@ -0,0 +1,134 @@
+// Elevator
+// - Limit switches: the pin change ISR stops the servo the moment the elevator reaches the
+//   limit it's being driven into (without any help from the loop), the stop is latched through
+//   switch bounce, and the elevator can still be driven off the limit.
+// - moveTo(): finds the bottom first if the height isn't known, stops within tolerance of
+//   heights in between (against a plant that moves at the modelled speed) and slows down on
+//   the way in.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Elevator.h"
+#include "TestUtil.h"
+
+// Plant: moves at ELEVATOR_MM_PER_SEC at full servo speed, limit switches at the ends
+static double s_heightMm;
+
+static void step(Elevator &elevator, unsigned long us) {
+  hostAdvanceMicros(us);
+  int angle = hostGetServo(ELEVATOR_SERVO_PIN);
+  s_heightMm += (ELEVATOR_SERVO_STOP - angle) / 90.0 * ELEVATOR_MM_PER_SEC * us / 1e6;
+  if(s_heightMm < 0) {
+    s_heightMm = 0;
+  }
+  else if(s_heightMm > ELEVATOR_STROKE_MM) {
+    s_heightMm = ELEVATOR_STROKE_MM;
+  }
+  hostSetPin(ELEVATOR_LOWER_LIMIT_SWITCH_PIN, s_heightMm <= 0);
+  hostSetPin(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, s_heightMm >= ELEVATOR_STROKE_MM);
+  elevator.update();
+}
+
+// Run a move to completion (or 10s) updating every loopUs, returns the time it took (ms)
+static long runMoveTo(Elevator &elevator, int heightMm, unsigned long loopUs, int *pSlowestPower) {
+  elevator.moveTo(heightMm);
+  *pSlowestPower = 256;
+  long us = 0;
+  while(elevator.isMoving() && us < 10000000L) {
+    step(elevator, loopUs);
+    int power = abs(elevator.getPower());
+    if(power && power < *pSlowestPower) {
+      *pSlowestPower = power;
+    }
+    us += loopUs;
+  }
+  return us / 1000;
+}
+
+// Moves updating every loopUs: 1ms, and as often as the loop really runs (the height estimate
+// has to hold up however small each update is)
+static void moveTo(unsigned long loopUs) {
+  printf("update every %luus\n", loopUs);
+  hostUseVirtualClock(true);
+  s_heightMm = 70;
+  hostSetPin(ELEVATOR_LOWER_LIMIT_SWITCH_PIN, LOW);
+  hostSetPin(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, LOW);
+  Elevator elevator;
+  elevator.init();
+  int slowest;
+
+  // Height unknown: goes to the bottom first, then up to the target
+  expect("calibrated at start", elevator.isCalibrated(), 0);
+  long ms = runMoveTo(elevator, 50, loopUs, &slowest);
+  printf("  moveTo(50) from unknown: %ldms, plant at %.1fmm, estimate %dmm\n", ms, s_heightMm,
+         elevator.getHeightMm());
+  expect("calibrated", elevator.isCalibrated(), 1);
+  expect("at 50mm", fabs(s_heightMm - 50) <= ELEVATOR_TOLERANCE_MM + 1, 1);
+  expect("slows down", slowest <= ELEVATOR_MIN_POWER, 1);
+
+  // In between, both ways
+  ms = runMoveTo(elevator, 90, loopUs, &slowest);
+  printf("  moveTo(90): %ldms, plant at %.1fmm, estimate %dmm\n", ms, s_heightMm,
+         elevator.getHeightMm());
+  expect("at 90mm", fabs(s_heightMm - 90) <= ELEVATOR_TOLERANCE_MM + 1, 1);
+  runMoveTo(elevator, 20, loopUs, &slowest);
+  printf("  moveTo(20): plant at %.1fmm, estimate %dmm\n", s_heightMm, elevator.getHeightMm());
+  expect("at 20mm", fabs(s_heightMm - 20) <= ELEVATOR_TOLERANCE_MM + 1, 1);
+
+  // All the way up ends on the switch
+  runMoveTo(elevator, ELEVATOR_STROKE_MM, loopUs, &slowest);
+  expect("moveTo(top) done", elevator.isMoving(), 0);
+  expect("moveTo(top) at the limit", elevator.isAtUpperLimit(), 1);
+
+  // setPower() takes over from a move
+  elevator.moveTo(0);
+  step(elevator, 1000);
+  elevator.setPower(0);
+  expect("cancelled", elevator.isMoving(), 0);
+  step(elevator, 1000);
+  expect("stopped", hostGetServo(ELEVATOR_SERVO_PIN), ELEVATOR_SERVO_STOP);
+}
+
+int main() {
+  hostSetPin(ELEVATOR_LOWER_LIMIT_SWITCH_PIN, LOW);
+  hostSetPin(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, LOW);
+  Elevator elevator;
+  elevator.init();
+
+  // Drive up into the upper limit: the ISR stops it
+  elevator.setPower(256);
+  expect("servo going up", hostGetServo(ELEVATOR_SERVO_PIN), 0);
+  hostSetPin(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, HIGH);
+  expect("servo at upper limit", hostGetServo(ELEVATOR_SERVO_PIN), ELEVATOR_SERVO_STOP);
+  expect("power at upper limit", elevator.getPower(), 0);
+  expect("isAtUpperLimit()", elevator.isAtUpperLimit(), 1);
+
+  // Switch bounces open: still latched, and driving up again is refused
+  hostSetPin(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, LOW);
+  expect("isAtUpperLimit() after bounce", elevator.isAtUpperLimit(), 1);
+  elevator.setPower(128);
+  expect("servo driven into upper limit", hostGetServo(ELEVATOR_SERVO_PIN), ELEVATOR_SERVO_STOP);
+
+  // Driving down clears the latch, and the upper switch doesn't stop it
+  hostSetPin(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, HIGH);
+  elevator.setPower(-256);
+  expect("servo going down", hostGetServo(ELEVATOR_SERVO_PIN), 180);
+  hostSetPin(ELEVATOR_UPPER_LIMIT_SWITCH_PIN, LOW);
+  expect("servo leaving upper limit", hostGetServo(ELEVATOR_SERVO_PIN), 180);
+  expect("isAtUpperLimit() after leaving", elevator.isAtUpperLimit(), 0);
+
+  // Lower limit
+  hostSetPin(ELEVATOR_LOWER_LIMIT_SWITCH_PIN, HIGH);
+  expect("servo at lower limit", hostGetServo(ELEVATOR_SERVO_PIN), ELEVATOR_SERVO_STOP);
+  expect("isAtLowerLimit()", elevator.isAtLowerLimit(), 1);
+  elevator.setPower(256);
+  expect("servo leaving lower limit", hostGetServo(ELEVATOR_SERVO_PIN), 0);
+  expect("isAtLowerLimit() after leaving", elevator.isAtLowerLimit(), 1);
+  hostSetPin(ELEVATOR_LOWER_LIMIT_SWITCH_PIN, LOW);
+  expect("isAtLowerLimit() off the switch", elevator.isAtLowerLimit(), 0);
+
+  moveTo(1000);
+  moveTo(150);
+
+  return testResult();
+}
@@ -0,0 +1,84 @@
+// Event log: records come back out of TelemetryDecoder in order, nothing is sent while the
+// Serial TX buffer is full, and overflow is counted rather than lost silently
+#include <stdio.h>
+#include "TelemetryDecoder.h"
+#include "TestUtil.h"
+
+int main() {
+  expect("sizeof(LogRecord)", sizeof(LogRecord), 14);
+
+  FILE *capture = tmpfile();
+  hostUseVirtualClock(true);
+  hostSerialSetOutput(capture);
+  EventLog log;
+
+  // A burst that fits, sent one record per loop
+  for(int i = 0; i < LOG_RECORDS; i++) {
+    log.log(logUltrasonic, i);
+  }
+  unsigned long before = hostSerialBytesWritten();
+  log.service();
+  expect("bytes sent by one service()", hostSerialBytesWritten() - before, sizeof(LogRecord));
+  for(int i = 0; i < LOG_RECORDS; i++) {
+    log.service();
+  }
+
+  // Nothing goes out while the TX buffer is full, and overflow is dropped and counted
+  hostSerialSetTxFree(sizeof(LogRecord) - 1);
+  for(int i = 0; i < LOG_RECORDS + 5; i++) {
+    log.log(logStraightDone, i, -i, 1000, -1000);
+    hostAdvanceMicros(1000);
+  }
+  before = hostSerialBytesWritten();
+  for(int i = 0; i < 100; i++) {
+    log.service();
+  }
+  expect("bytes sent while TX full", hostSerialBytesWritten() - before, 0);
+  hostSerialSetTxFree(63);
+  for(int i = 0; i < 100; i++) {
+    log.service();
+  }
+  log.trace(__LINE__, "text");
+  log.service();
+  hostSerialSetOutput(NULL);
+
+  // Decode
+  rewind(capture);
+  TelemetryDecoder decoder;
+  TelemetryData data;
+  LogRecord record;
+  long idx = 0;
+  int c;
+  while((c = fgetc(capture)) != EOF) {
+    if(decoder.feed((uint8_t)c, &data, &record) != decodedLog) {
+      continue;
+    }
+    if(idx < LOG_RECORDS) {
+      expect("event", record.u8Event, logUltrasonic);
+      expect("mm", record.i16Data[0], idx);
+    }
+    else if(idx < 2 * LOG_RECORDS) {
+      int i = idx - LOG_RECORDS;
+      expect("event", record.u8Event, logStraightDone);
+      expect("ticks", record.i16Data[0], i);
+      expect("target", record.i16Data[1], -i);
+      expect("right", record.i16Data[3], -1000);
+      expect("time", decoder.getLogTimeMs(), i);
+    }
+    else if(idx == 2 * LOG_RECORDS) {
+      expect("event", record.u8Event, logDropped);
+      expect("dropped", record.i16Data[0], 5);
+    }
+    else {
+      expect("event", record.u8Event, logTrace);
+    }
+    idx++;
+  }
+  fclose(capture);
+
+  printf("%lu records decoded, %lu bad\n", decoder.getRecords(), decoder.getBad());
+  expect("records", idx, 2 * LOG_RECORDS + 2);
+  expect("bad", decoder.getBad(), 0);
+
+  return testResult();
+}
@@ -0,0 +1,70 @@
+// Checks the fixed-point math against the float code it replaced
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Drivetrain.h"
+#include "TestUtil.h"
+
+// Float versions of the factors (as they were before the fixed-point change)
+#define FLOAT_TICKS_TO_MM_FACTOR  ((float)(178/905.0))
+#define FLOAT_WHEEL_BASE_MM       145.0
+
+////////////////////////////////////////////////////////////////////
+// Compare a fixed-point result with the float one.  Results may differ by one count where the
+// float value sits right on an integer boundary (more where the fixed-point version
+// interpolates).
+static void check(const char *pName, long input, long fixed, long reference, long *pMaxErr,
+                  long tolerance = 1) {
+  long err = labs(fixed - reference);
+  if(err > *pMaxErr) {
+    *pMaxErr = err;
+  }
+  if(err > tolerance) {
+    if(testFailed()) {
+      printf("FAIL %s(%ld) = %ld, float gives %ld\n", pName, input, fixed, reference);
+    }
+  }
+}
+
+int main() {
+  WheelEncoder encoder;
+  encoder.init(LEFT_WHEEL_ENCODER_PIN, true);
+  encoder.setTicksToDistanceFactor(TICKS_TO_MM_FACTOR);
+
+  long maxErr = 0;
+  for(int mm = -5000; mm <= 5000; mm++) {
+    check("getNumTicksInDistance", mm, encoder.getNumTicksInDistance(mm),
+          (int)((float)mm * FLOAT_TICKS_TO_MM_FACTOR), &maxErr);
+  }
+  printf("getNumTicksInDistance: max error %ld tick(s)\n", maxErr);
+
+  maxErr = 0;
+  for(int ticks = -1000; ticks <= 1000; ticks++) {
+    g_leftEncoder.count = ticks;
+    check("getDistanceMm", ticks, encoder.getDistanceMm(), (int)(ticks / FLOAT_TICKS_TO_MM_FACTOR), &maxErr);
+  }
+  printf("getDistanceMm: max error %ld mm\n", maxErr);
+
+  maxErr = 0;
+  for(int deg = -720; deg <= 720; deg++) {
+    check("rotateDegToMm", deg, Drivetrain::rotateDegToMm(deg),
+          (int)(FLOAT_WHEEL_BASE_MM * PI * (long)deg / 360), &maxErr);
+  }
+  printf("rotateDegToMm: max error %ld mm\n", maxErr);
+
+  maxErr = 0;
+  for(unsigned long value = 0; value < 4000000UL; value += 7) {
+    check("isqrt", value, isqrt(value), (long)sqrt((double)value), &maxErr);
+  }
+  check("isqrt", 0xFFFFFFFFUL, isqrt(0xFFFFFFFFUL), 65535, &maxErr);
+  printf("isqrt: max error %ld\n", maxErr);
+
+  maxErr = 0;
+  for(long angle = 0; angle < ANGLE_FULL_TURN; angle += 3) {
+    check("isin", angle, isin(angle), lround(sin(angle * 2 * PI / ANGLE_FULL_TURN) * TRIG_ONE), &maxErr, 2);
+    check("icos", angle, icos(angle), lround(cos(angle * 2 * PI / ANGLE_FULL_TURN) * TRIG_ONE), &maxErr, 2);
+  }
+  printf("isin/icos: max error %ld (Q14)\n", maxErr);
+
+  return testResult();
+}
@@ -0,0 +1,56 @@
+// Gripper motion model: isSettled() comes true when the jaws have had time to travel (not
+// after a fixed wait), moves from part way through a swing are timed from where the jaws are,
+// and a slowed moveTo() steps the servo over the right time.
+#include <stdio.h>
+#include "Gripper.h"
+#include "TestUtil.h"
+
+// Time (ms) until isSettled(), stepping 1ms at a time
+static long timeToSettle(Gripper &gripper, unsigned int marginMs = GRIPPER_SETTLE_MARGIN_MS) {
+  long ms = 0;
+  while(!gripper.isSettled(marginMs) && ms < 10000) {
+    hostAdvanceMicros(1000);
+    gripper.update();
+    ms++;
+  }
+  return ms;
+}
+
+int main() {
+  hostUseVirtualClock(true);
+  Gripper gripper;
+  gripper.init();
+  long fullSwingMs = (long)(CLOSED_POS - OPENED_POS) * 1000 / GRIPPER_SERVO_DEG_PER_SEC;
+
+  // Power-up allows for a full swing
+  expect("init settle", timeToSettle(gripper), fullSwingMs + GRIPPER_SETTLE_MARGIN_MS);
+
+  // Close and open: the swing time plus the margin
+  gripper.close();
+  expect("closing", hostGetServo(GRIPPER_SERVO_PIN), CLOSED_POS);
+  long closeMs = timeToSettle(gripper);
+  printf("close settles after %ldms (was a fixed 500ms wait)\n", closeMs);
+  expect("close settle", closeMs, fullSwingMs + GRIPPER_SETTLE_MARGIN_MS);
+  expect("angle closed", gripper.getAngle(), CLOSED_POS);
+  gripper.open();
+  expect("open settle (no margin)", timeToSettle(gripper, 0), fullSwingMs);
+
+  // Reverse half way through a close: only the distance travelled so far to come back
+  gripper.close();
+  hostAdvanceMicros(fullSwingMs * 500);
+  expect("angle half way", gripper.getAngle(), (OPENED_POS + CLOSED_POS) / 2);
+  gripper.open();
+  expect("reverse settle", timeToSettle(gripper, 0), fullSwingMs / 2);
+
+  // Slowed move: the servo is stepped there at the requested rate
+  gripper.moveTo(CLOSED_POS, 100);
+  expect("slowed first write", hostGetServo(GRIPPER_SERVO_PIN), OPENED_POS);
+  hostAdvanceMicros(300000);
+  gripper.update();
+  expect("slowed after 300ms", hostGetServo(GRIPPER_SERVO_PIN), OPENED_POS + 30);
+  expect("slowed settle", timeToSettle(gripper, 0), (CLOSED_POS - OPENED_POS) * 10 - 300);
+  expect("slowed end", hostGetServo(GRIPPER_SERVO_PIN), CLOSED_POS);
+  expect("isOpen() after closing", gripper.isOpen(), 0);
+
+  return testResult();
+}
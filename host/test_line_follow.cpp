@@ -0,0 +1,159 @@
+// Line followers
+// - Digital: every sensor pattern gives the same powers as the old if/else chain, except the
+//   crossing line, which now stops (and stays stopped) instead of driving straight on.  Each
+//   pass samples the sensors with a single port read.
+// - Analog: the PD steering goes the right way and in proportion to the line position, runs
+//   once per period, stops on a crossing line and turns back when the line is lost.  The
+//   steering is limited and there's no D term kick when the line is found again.
+#include <stdio.h>
+#include <stdlib.h>
+#include "Drivetrain.h"
+#include "TestUtil.h"
+
+#define P  LINE_FOLLOW_STRAIGHT_POWER
+#define T  LINE_FOLLOW_TURN_POWER
+
+static void expect(const char *pName, int pattern, long value, long expected) {
+  if(value != expected) {
+    if(testFailed()) {
+      printf("FAIL pattern %d: %s = %ld, expected %ld\n", pattern, pName, value, expected);
+    }
+  }
+}
+
+// Analog readings (0 = black .. 1023 = white)
+static void setAnalog(int left, int middle, int right) {
+  hostSetAnalog(LINE_LEFT_PIN, left);
+  hostSetAnalog(LINE_MIDDLE_PIN, middle);
+  hostSetAnalog(LINE_RIGHT_PIN, right);
+}
+
+// Run one PD period and return the steering (left - right power) / 2
+static int steerFor(Drivetrain &drivetrain, int left, int middle, int right) {
+  setAnalog(left, middle, right);
+  hostAdvanceMicros(LINE_FOLLOW_PERIOD_US);
+  drivetrain.lineFollowAnalog();
+  return (drivetrain.getLeftPower() - drivetrain.getRightPower()) / 2;
+}
+
+static void analog(Drivetrain &drivetrain) {
+  // Line in the middle: straight at the PD base power
+  steerFor(drivetrain, 1000, 0, 1000);
+  steerFor(drivetrain, 1000, 0, 1000);
+  expect("centred left power", 0, drivetrain.getLeftPower(), LINE_FOLLOW_PD_POWER);
+  expect("centred right power", 0, drivetrain.getRightPower(), LINE_FOLLOW_PD_POWER);
+
+  // Line drifting right (steady, so no D term): steer right, more for a bigger offset
+  steerFor(drivetrain, 1000, 300, 600);
+  int small = steerFor(drivetrain, 1000, 300, 600);
+  steerFor(drivetrain, 1000, 700, 300);
+  int large = steerFor(drivetrain, 1000, 700, 300);
+  printf("analog: steering %d for a small offset right, %d for a large one\n", small, large);
+  expect("steers right", 0, small > 0, 1);
+  expect("steers more", 0, large > small, 1);
+
+  // Mirror image steers left by the same amount (give or take rounding)
+  steerFor(drivetrain, 600, 300, 1000);
+  expect("steers left", 0, abs(steerFor(drivetrain, 600, 300, 1000) + small) <= 1, 1);
+
+  // The D term adds to the steering while the line is moving away
+  steerFor(drivetrain, 1000, 0, 1000);
+  int moving = steerFor(drivetrain, 1000, 300, 600);
+  expect("D term", 0, moving > small, 1);
+
+  // Only runs once per period
+  setAnalog(1000, 0, 1000);
+  drivetrain.lineFollowAnalog();
+  expect("waits for the period", 0, (drivetrain.getLeftPower() - drivetrain.getRightPower()) / 2, moving);
+
+  // Lost the line after it was last seen on the left: turn hard left
+  steerFor(drivetrain, 300, 700, 1000);
+  steerFor(drivetrain, 1023, 1023, 1023);
+  expect("lost left power", 0, drivetrain.getLeftPower(), -LINE_FOLLOW_TURN_POWER);
+  expect("lost right power", 0, drivetrain.getRightPower(), LINE_FOLLOW_TURN_POWER);
+
+  // Finding the line again: no D term kick from the position before it was lost
+  steerFor(drivetrain, 1023, 1023, 1023);
+  int found = steerFor(drivetrain, 1000, 300, 600);
+  expect("no kick after a loss", 0, found, small);
+
+  // Line jumping from far left to far right: the steering is limited, so the slow side stops
+  // rather than driving backwards
+  steerFor(drivetrain, 0, 1000, 1000);
+  steerFor(drivetrain, 1000, 1000, 0);
+  expect("steering limited (left)", 0, drivetrain.getLeftPower(), 255);
+  expect("steering limited (right)", 0, drivetrain.getRightPower(), 0);
+
+  // Starting again after an abort: no D term either
+  drivetrain.abortAuto();
+  expect("no kick after a restart", 0, steerFor(drivetrain, 1000, 300, 600), small);
+
+  // Crossing line: stop
+  setAnalog(50, 0, 80);
+  hostAdvanceMicros(LINE_FOLLOW_PERIOD_US);
+  expect("crossing", 0, drivetrain.lineFollowAnalog(), 1);
+  expect("crossing left power", 0, drivetrain.getLeftPower(), 0);
+  expect("crossing right power", 0, drivetrain.getRightPower(), 0);
+}
+
+static void setLine(uint8_t pattern) {
+  // Sensors read 0 over the line
+  hostSetPin(LINE_LEFT_PIN, !(pattern & LINE_LEFT));
+  hostSetPin(LINE_MIDDLE_PIN, !(pattern & LINE_MIDDLE));
+  hostSetPin(LINE_RIGHT_PIN, !(pattern & LINE_RIGHT));
+}
+
+int main() {
+  hostUseVirtualClock(true);
+  Drivetrain drivetrain;
+  drivetrain.init();
+
+  // Expected powers for each pattern with the last turn to the right / left
+  static const int expected[8][2][2] = {
+    { { T, -T }, { -T, T } },   // ---  lost the line, keep turning
+    { { -T, T }, { -T, T } },   // L--
+    { { P, P }, { P, P } },     // -M-
+    { { P, P }, { P, P } },     // LM-
+    { { T, -T }, { T, -T } },   // --R
+    { { -T, T }, { -T, T } },   // L-R
+    { { P, P }, { P, P } },     // -MR
+    { { 0, 0 }, { 0, 0 } },     // LMR  crossing line
+  };
+  for(int lastLeft = 0; lastLeft < 2; lastLeft++) {
+    for(int pattern = 0; pattern < 8; pattern++) {
+      // Set up the last turn, then try the pattern
+      setLine(lastLeft ? LINE_LEFT : LINE_RIGHT);
+      drivetrain.lineFollowDigital();
+      setLine(pattern);
+      expect("readLineSensors()", pattern, drivetrain.readLineSensors(), pattern);
+      bool crossing = drivetrain.lineFollowDigital();
+      expect("crossing", pattern, crossing, pattern == 7);
+      expect("left power", pattern, drivetrain.getLeftPower(), expected[pattern][lastLeft][0]);
+      expect("right power", pattern, drivetrain.getRightPower(), expected[pattern][lastLeft][1]);
+    }
+  }
+
+  // Stays stopped on the crossing line
+  setLine(LINE_LEFT | LINE_MIDDLE | LINE_RIGHT);
+  for(int i = 0; i < 10; i++) {
+    drivetrain.lineFollowDigital();
+    expect("left power (crossing)", 7, drivetrain.getLeftPower(), 0);
+    expect("right power (crossing)", 7, drivetrain.getRightPower(), 0);
+  }
+
+  // One port read per pass (plus a write to each direction pin for the change to straight)
+  unsigned long fastIo = hostGetFastIoCount();
+  unsigned long coreIo = hostGetCoreIoCount();
+  setLine(LINE_MIDDLE);
+  drivetrain.lineFollowDigital();
+  long portReads = hostGetFastIoCount() - fastIo - 4;
+  printf("one pass: %ld port read(s), %lu digitalRead/Write call(s)\n",
+         portReads, hostGetCoreIoCount() - coreIo);
+#ifndef SLOW_IO
+  expect("port reads per pass", LINE_MIDDLE, portReads, 1);
+#endif
+
+  analog(drivetrain);
+
+  return testResult();
+}
@@ -0,0 +1,36 @@
+// PwmServo: the Timer1 compare values give the same pulses as the Servo library (544us..2400us
+// for 0..180 degrees, 0.5us ticks), within the 20ms period, and writes reach the host HAL.
+#include <stdio.h>
+#include "PwmServo.h"
+#include "TestUtil.h"
+
+int main() {
+  expect("0 deg", PwmServo::angleToTicks(0), 544 * 2);
+  expect("180 deg", PwmServo::angleToTicks(180), 2400 * 2);
+  expect("clamped low", PwmServo::angleToTicks(-10), 544 * 2);
+  expect("clamped high", PwmServo::angleToTicks(200), 2400 * 2);
+  // Continuous servo stop: the Servo library gives 544 + 90 * 1856 / 180 = 1472us
+  expect("90 deg", PwmServo::angleToTicks(90), 1472 * 2);
+
+  // Same as the Servo library's map() for every angle, and monotonic
+  for(int angle = 0; angle <= 180; angle++) {
+    long us = 544 + (long)angle * (2400 - 544) / 180;
+    expect("matches Servo", PwmServo::angleToTicks(angle), us * PWM_SERVO_TICKS_PER_US);
+    if(angle > 0) {
+      expect("monotonic", PwmServo::angleToTicks(angle) > PwmServo::angleToTicks(angle - 1), 1);
+    }
+  }
+  expect("fits the period",
+         PwmServo::angleToTicks(180) < PWM_SERVO_PERIOD_US * PWM_SERVO_TICKS_PER_US, 1);
+
+  PwmServo servo;
+  expect("unwritten", servo.read(), -1);
+  servo.attach(GRIPPER_SERVO_PIN);
+  servo.write(45);
+  expect("read", servo.read(), 45);
+  expect("host servo", hostGetServo(GRIPPER_SERVO_PIN), 45);
+  servo.write(300);
+  expect("read clamped", servo.read(), 180);
+
+  return testResult();
+}
@@ -0,0 +1,84 @@
+// Telemetry: packets sent by Telemetry.h come back out of TelemetryDecoder intact, at the
+// configured rate, with the sketch's text output mixed in
+#include <stdio.h>
+#include "TelemetryDecoder.h"
+#include "TestUtil.h"
+
+#define RUN_MS  10000
+
+int main() {
+  expect("sizeof(TelemetryData)", sizeof(TelemetryData), 36);
+
+  // Run the sender on the virtual clock with 250us loops, capturing Serial
+  FILE *capture = tmpfile();
+  hostUseVirtualClock(true);
+  hostSerialSetOutput(capture);
+  Telemetry telemetry;
+  telemetry.init();
+  long sent = 0;
+  unsigned long startMs = millis();
+  while(millis() - startMs < RUN_MS) {
+    hostAdvanceMicros(250);
+    if(telemetry.update()) {
+      TelemetryData data;
+      data.i16LeftTicks = sent;
+      data.i16RightTicks = -sent;
+      data.i16XMm = 1000;
+      data.i16YMm = -1000;
+      data.u16Heading = 0x4000;
+      data.i16LeftPower = 255;
+      data.i16RightPower = -255;
+      data.i16ElevatorPower = -256;
+      data.i16UltrasonicMm = -1;
+      data.i8CmdStep = sent % 20 - 1;
+      data.u8Busy = 0x07;
+      data.u8Flags = TELEM_LINE_MIDDLE | TELEM_GRIPPER_OPEN;
+      data.u8LinkErrors = 0;
+      telemetry.send(data);
+      sent++;
+    }
+    // Text in between, including a stray preamble ('Z')
+    if(sent % 7 == 3 && millis() % 50 == 10) {
+      Serial.println("Ending straight drive (Z 5 of 5)");
+    }
+  }
+  hostSerialSetOutput(NULL);
+
+  // Decode it
+  rewind(capture);
+  TelemetryDecoder decoder;
+  TelemetryData data;
+  LogRecord record;
+  long decoded = 0;
+  unsigned long lastTimeMs = 0;
+  int c;
+  while((c = fgetc(capture)) != EOF) {
+    if(decoder.feed((uint8_t)c, &data, &record) == decodedTelemetry) {
+      expect("seq", data.u8Seq, decoded & 0xff);
+      expect("i16LeftTicks", data.i16LeftTicks, decoded);
+      expect("i16RightTicks", data.i16RightTicks, -decoded);
+      expect("i16YMm", data.i16YMm, -1000);
+      expect("u16Heading", data.u16Heading, 0x4000);
+      expect("i16ElevatorPower", data.i16ElevatorPower, -256);
+      expect("i8CmdStep", data.i8CmdStep, decoded % 20 - 1);
+      expect("u8Flags", data.u8Flags, TELEM_LINE_MIDDLE | TELEM_GRIPPER_OPEN);
+      expect("u16MaxLoopUs", data.u16MaxLoopUs, 250);
+      if(decoded > 1) {
+        // The first packet goes out on the first loop, so the next one has a loop less
+        expect("period", data.u32TimeMs - lastTimeMs, TELEMETRY_PERIOD_MS);
+        expect("u16Loops", data.u16Loops, TELEMETRY_PERIOD_MS * 4);
+      }
+      lastTimeMs = data.u32TimeMs;
+      decoded++;
+    }
+  }
+  fclose(capture);
+
+  printf("%ld packets sent, %lu decoded, %lu missed, %lu bad, %lu bytes on Serial\n", sent,
+         decoder.getPackets(), decoder.getMissed(), decoder.getBad(), hostSerialBytesWritten());
+  expect("packets", decoded, sent);
+  expect("packets in run", sent, RUN_MS / TELEMETRY_PERIOD_MS + 1);
+  expect("bad packets", decoder.getBad(), 0);
+
+  return testResult();
+}
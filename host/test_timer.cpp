@@ -0,0 +1,87 @@
+// Timers across the clock wrapping: Timer and TimerService deadlines set just before millis()
+// (or micros()) wraps expire on time, not straight away or 49 days late.  TimerService runs
+// several deadlines at once, periodic ones keep to their period, and cancel() works.
+#include <stdio.h>
+#include "Timer.h"
+#include "TestUtil.h"
+
+static int s_fastCount = 0;
+static int s_slowCount = 0;
+static int s_usCount = 0;
+static int s_cancelledCount = 0;
+static void fast() { s_fastCount++; }
+static void slow() { s_slowCount++; }
+static void usTick() { s_usCount++; }
+static void cancelled() { s_cancelledCount++; }
+
+// Step the clock 1ms at a time, servicing the timers
+static void run(TimerService &timers, long ms) {
+  for(long i = 0; i < ms; i++) {
+    hostAdvanceMicros(1000);
+    timers.service();
+  }
+}
+
+int main() {
+  hostUseVirtualClock(true);
+
+  // Move to 1s before millis() wraps
+  hostAdvanceMicros((0x100000000ULL - 1000) * 1000);
+  expect("near the wrap", millis(), 0xFFFFFFFFL - 999);
+
+  // Timer across the wrap
+  Timer timer;
+  timer.set(2000);
+  expect("not expired at the start", timer.isExpired(), 0);
+  hostAdvanceMicros(1500 * 1000);
+  expect("wrapped", millis() < 1000, 1);
+  expect("not expired after the wrap", timer.isExpired(), 0);
+  hostAdvanceMicros(500 * 1000);
+  expect("expired on time", timer.isExpired(), 1);
+
+  // Microsecond Timer across the micros() wrap
+  hostAdvanceMicros(0x100000000ULL - micros() - 100);
+  timer.setUs(300);
+  hostAdvanceMicros(299);
+  expect("us not expired", timer.isExpired(), 0);
+  hostAdvanceMicros(1);
+  expect("us expired", timer.isExpired(), 1);
+
+  // TimerService: several deadlines at once, across the millis() wrap
+  hostAdvanceMicros((0x100000000ULL - millis() - 50) * 1000);
+  TimerService timers;
+  uint8_t fastId = timers.startMs(10, fast, true);
+  timers.startMs(100, slow);
+  uint8_t usId = timers.startUs(2500, usTick, true);
+  uint8_t cancelId = timers.startMs(20, cancelled);
+  expect("fourth timer", cancelId != NO_TIMER, 1);
+  expect("full", timers.startMs(1, fast), NO_TIMER);
+  timers.cancel(cancelId);
+  expect("cancelled", timers.isActive(cancelId), 0);
+  run(timers, 99);
+  expect("periodic count", s_fastCount, 9);
+  expect("one-shot not yet", s_slowCount, 0);
+  run(timers, 1);
+  expect("periodic count at 100ms", s_fastCount, 10);
+  expect("one-shot", s_slowCount, 1);
+  expect("one-shot done", timers.isActive(1), 0);
+  expect("cancelled didn't fire", s_cancelledCount, 0);
+  // Serviced once a ms, so a 2.5ms period fires 40 times in 100ms
+  expect("us periodic count", s_usCount, 40);
+  run(timers, 100);
+  expect("one-shot only once", s_slowCount, 1);
+  timers.cancel(fastId);
+  timers.cancel(usId);
+  run(timers, 100);
+  expect("periodic after cancel", s_fastCount, 20);
+
+  // A periodic timer that falls behind doesn't fire in a burst to catch up
+  s_fastCount = 0;
+  timers.startMs(10, fast, true);
+  hostAdvanceMicros(55 * 1000);
+  timers.service();
+  run(timers, 10);
+  expect("no catch-up burst", s_fastCount, 2);
+
+  return testResult();
+}